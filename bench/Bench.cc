@@ -0,0 +1,267 @@
+#include "Synthetic.hh"
+
+#include "BSPWriter.hh"
+#include "ClassHistogram.hh"
+#include "EntityFilter.hh"
+#include "EntityParser.hh"
+#include "EntityStore.hh"
+#include "EntityTree.hh"
+#include "LumpStats.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "ShaderStats.hh"
+#include "Visibility.hh"
+
+#include <libbsp.hh>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+
+namespace {
+	
+	struct Timing {
+		QString name;
+		std::vector<double> ms;
+		
+		QJsonObject json() const {
+			double total = 0;
+			for (double v : ms) total += v;
+			QJsonObject obj;
+			obj["name"] = name;
+			obj["iterations"] = (int)ms.size();
+			obj["min_ms"] = *std::min_element(ms.begin(), ms.end());
+			obj["mean_ms"] = total / ms.size();
+			obj["max_ms"] = *std::max_element(ms.begin(), ms.end());
+			return obj;
+		}
+	};
+	
+	// setup runs untimed before every iteration
+	Timing measure(QString name, int iterations, std::function<void()> const & setup, std::function<void()> const & fn) {
+		Timing t { name, {} };
+		for (int i = 0; i < iterations; i++) {
+			if (setup) setup();
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			auto end = std::chrono::steady_clock::now();
+			t.ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return t;
+	}
+	
+	size_t option_size(QCommandLineParser const & parser, QString const & name, size_t def) {
+		if (!parser.isSet(name)) return def;
+		bool ok = false;
+		size_t v = parser.value(name).toULongLong(&ok);
+		return ok ? v : def;
+	}
+}
+
+int main(int argc, char * * argv) {
+	
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	QApplication app { argc, argv };
+	
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Times bspium open, parse, model, filter, sort, edit and save phases.");
+	parser.addHelpOption();
+	parser.addOption({ "input", "Benchmark an existing BSP instead of a generated one.", "file" });
+	parser.addOption({ "entities", "Generated entity count.", "count" });
+	parser.addOption({ "fields", "Generated fields per entity.", "count" });
+	parser.addOption({ "elements", "Generated elements per fixed size lump.", "count" });
+	parser.addOption({ "lightmaps", "Generated lightmap count.", "count" });
+	parser.addOption({ "clusters", "Generated visibility cluster count.", "count" });
+	parser.addOption({ { "n", "iterations" }, "Iterations per phase.", "count", "5" });
+	parser.addOption({ "edits", "setData calls per edit burst.", "count", "1000" });
+	parser.addOption({ "filter", "Filter text to benchmark.", "text", "t12" });
+	parser.addOption({ { "o", "output" }, "Write JSON results to a file instead of stdout.", "file" });
+	parser.process(app);
+	
+	QTextStream err { stderr };
+	QTemporaryDir tmp;
+	if (!tmp.isValid()) {
+		err << "unable to create temporary directory\n";
+		return 1;
+	}
+	
+	SyntheticBSP params;
+	params.entities = option_size(parser, "entities", params.entities);
+	params.fields = std::max<size_t>(1, option_size(parser, "fields", params.fields));
+	params.elements = option_size(parser, "elements", params.elements);
+	params.lightmaps = option_size(parser, "lightmaps", params.lightmaps);
+	params.clusters = option_size(parser, "clusters", params.clusters);
+	if (params.clusters > INT32_MAX || params.visibility_bytes() > INT32_MAX) {
+		err << "--clusters " << params.clusters << " would need a visibility lump over 2GB\n";
+		return 1;
+	}
+	int iterations = std::max<int>(1, parser.value("iterations").toInt());
+	size_t edits = option_size(parser, "edits", 1000);
+	
+	QString input = parser.value("input");
+	if (input.isEmpty()) {
+		input = tmp.filePath("synthetic.bsp");
+		QFile f { input };
+		QByteArray data = params.generate();
+		if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size()) {
+			err << "unable to write synthetic BSP\n";
+			return 1;
+		}
+	}
+	
+	QFile file { input };
+	if (!file.open(QIODevice::ReadOnly)) {
+		err << "unable to open " << input << '\n';
+		return 1;
+	}
+	uchar * map = file.map(0, file.size(), QFileDevice::MapPrivateOption);
+	RawBSP raw;
+	if (!map || !raw.rebase(map, file.size())) {
+		err << input << " is not a valid BSP\n";
+		return 1;
+	}
+	
+	std::vector<Timing> results;
+	BSP::Reader bspr;
+	BSP::Reader::EntityArray ents;
+	std::shared_ptr<EntityStore> store;
+	
+	results.push_back(measure("open", iterations, {}, [&](){
+		bspr.rebase(map);
+		ents = bspr.entities_parsed();
+		LumpStats::compute(bspr, ents.size());
+	}));
+	
+	results.push_back(measure("intern", iterations, {}, [&](){
+		store = EntityStore::from_entities(ents);
+	}));
+	
+	// the mapping outlives every store built here, so nothing needs to keep it alive
+	results.push_back(measure("parse_in_place", iterations, {}, [&](){
+		auto lump = raw.lump(RBSP::ENTITIES);
+		std::string error;
+		if (!EntityParser::parse({ reinterpret_cast<char const *>(lump.data()), lump.size() }, nullptr, 0, error))
+			err << "in place parse failed: " << QString::fromStdString(error) << '\n';
+	}));
+	
+	results.push_back(measure("class_histogram", iterations, {}, [&](){
+		ClassHistogramModel::compute(*store);
+	}));
+	
+	results.push_back(measure("shader_stats", iterations, {}, [&](){
+		ShaderStatsModel::compute(raw);
+	}));
+	
+	results.push_back(measure("visibility", iterations, {}, [&](){
+		Visibility::analyze(raw);
+	}));
+	
+	std::unique_ptr<EntityTreeModel> model;
+	results.push_back(measure("model_build", iterations, [&](){ model.reset(); }, [&](){
+		model.reset( new EntityTreeModel { store } );
+	}));
+	
+	if (!parser.value("filter").isEmpty()) {
+		EntityFilterProxy proxy;
+		proxy.set_debounce_interval(0);
+		proxy.setSourceModel(model.get());
+		QString filter = parser.value("filter");
+		QEventLoop loop;
+		QObject::connect(&proxy, &EntityFilterProxy::filter_applied, &loop, &QEventLoop::quit);
+		results.push_back(measure("filter", iterations, [&](){
+			proxy.set_filter_text({});
+		}, [&](){
+			proxy.set_filter_text(filter);
+			loop.exec();
+		}));
+	}
+	
+	{
+		// alternates columns so every iteration is a full re-sort, the first one also builds the keys
+		EntityFilterProxy proxy;
+		proxy.setSourceModel(model.get());
+		int sort_round = 0;
+		results.push_back(measure("sort", iterations, {}, [&](){
+			proxy.sort(1 + sort_round++ % 2);
+		}));
+	}
+	
+	std::mt19937 rng { params.seed };
+	std::vector<QModelIndex> edit_targets;
+	int entity_rows = model->rowCount({});
+	for (size_t i = 0; i < edits && entity_rows; i++) {
+		QModelIndex ent = model->index(rng() % entity_rows, 0);
+		int field_rows = model->rowCount(ent);
+		if (field_rows) edit_targets.push_back(model->index(rng() % field_rows, 1, ent));
+	}
+	int edit_round = 0;
+	results.push_back(measure("set_data_burst", iterations, {}, [&](){
+		QString value = QString { "edited %1" }.arg(edit_round++);
+		for (auto const & idx : edit_targets) model->setData(idx, value);
+	}));
+	
+	results.push_back(measure("assemble", iterations, {}, [&](){
+		BSP::LumpProviderPtr pprov = std::make_shared<BSP::BSPReaderLumpProvider>( bspr );
+		BSP::Assembler bspa { pprov };
+		bspa[BSP::LumpIndex::ENTITIES] = model->generate_provider();
+		bspa.assemble();
+	}));
+	
+	QString save_path = tmp.filePath("saved.bsp");
+	auto save = [&](){
+		BSPWriter writer { raw };
+		writer.replace(RBSP::ENTITIES, [&](QIODevice & dev){
+			return model->write_entities(dev);
+		});
+		QString error;
+		if (!writer.write(save_path, error)) err << "save failed: " << error << '\n';
+	};
+	results.push_back(measure("save", iterations, {}, save));
+	results.push_back(measure("save_after_edit", iterations, [&](){
+		if (!edit_targets.empty()) model->setData(edit_targets.front(), QString { "edited %1" }.arg(edit_round++));
+	}, save));
+	
+	QJsonObject generated;
+	generated["entities"] = (qint64)params.entities;
+	generated["fields"] = (qint64)params.fields;
+	generated["elements"] = (qint64)params.elements;
+	generated["lightmaps"] = (qint64)params.lightmaps;
+	generated["clusters"] = (qint64)params.clusters;
+	
+	QJsonArray timings;
+	for (auto const & t : results) timings.append(t.json());
+	
+	QJsonObject root;
+	root["version"] = BSPIUM_VERSION;
+	root["input"] = parser.isSet("input") ? QJsonValue { input } : QJsonValue { generated };
+	root["file_size"] = file.size();
+	root["entity_count"] = (qint64)ents.size();
+	root["entity_store_bytes"] = (qint64)store->memory_estimate();
+	root["model_bytes"] = (qint64)model->memory_estimate();
+	root["results"] = timings;
+	QByteArray json = QJsonDocument { root }.toJson();
+	
+	if (parser.isSet("output")) {
+		QFile out { parser.value("output") };
+		if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate) || out.write(json) != json.size()) {
+			err << "unable to write " << out.fileName() << '\n';
+			return 1;
+		}
+	} else {
+		QTextStream { stdout } << json;
+	}
+	return 0;
+}
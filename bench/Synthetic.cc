@@ -0,0 +1,104 @@
+#include "Synthetic.hh"
+
+#include "RawBSP.hh"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string>
+
+namespace {
+	
+	// on-disk RBSP element sizes, in lump order
+	constexpr std::array<size_t, RawBSP::lump_count> element_sizes {
+		0,   // entities
+		72,  // shaders
+		16,  // planes
+		36,  // nodes
+		48,  // leafs
+		4,   // leaf surfaces
+		4,   // leaf brushes
+		40,  // models
+		12,  // brushes
+		12,  // brush sides
+		80,  // draw verts
+		4,   // draw indices
+		72,  // fogs
+		148, // surfaces
+		128 * 128 * 3, // lightmaps
+		30,  // lightgrid
+		0,   // visibility
+		2,   // lightarray
+	};
+	
+	constexpr std::array<char const *, 8> classnames {
+		"info_player_start",
+		"light",
+		"func_door",
+		"trigger_multiple",
+		"target_speaker",
+		"misc_model",
+		"func_static",
+		"target_relay",
+	};
+	
+	std::string entity_lump(SyntheticBSP const & params) {
+		std::mt19937 rng { params.seed };
+		std::uniform_int_distribution<int> coord { -8192, 8192 };
+		std::string str;
+		str.reserve(params.entities * params.fields * 32);
+		auto field = [&](std::string const & key, std::string const & value){
+			str += '"' + key + "\" \"" + value + "\"\n";
+		};
+		for (size_t i = 0; i < params.entities; i++) {
+			str += "{\n";
+			field("classname", i ? classnames[rng() % classnames.size()] : "worldspawn");
+			size_t written = 1;
+			if (i && written++ < params.fields) field("targetname", "t" + std::to_string(i));
+			if (i && written++ < params.fields) field("target", "t" + std::to_string(1 + rng() % params.entities));
+			if (i && written++ < params.fields) field("origin", std::to_string(coord(rng)) + ' ' + std::to_string(coord(rng)) + ' ' + std::to_string(coord(rng)));
+			for (size_t f = 0; written < params.fields; f++, written++)
+				field("key" + std::to_string(f), "value " + std::to_string(rng() % 1000));
+			str += "}\n";
+		}
+		str += '\0';
+		return str;
+	}
+}
+
+size_t SyntheticBSP::visibility_bytes() const {
+	return 8 + clusters * cluster_bytes();
+}
+
+size_t SyntheticBSP::cluster_bytes() const {
+	return ((clusters + 63) & ~size_t { 63 }) / 8;
+}
+
+QByteArray SyntheticBSP::generate() const {
+	
+	std::array<QByteArray, RawBSP::lump_count> lumps;
+	std::string ents = entity_lump(*this);
+	lumps[0] = QByteArray { ents.data(), (int)ents.size() };
+	for (size_t i = 1; i < RawBSP::lump_count; i++) {
+		size_t count = (i == 14) ? lightmaps : elements;
+		lumps[i] = QByteArray(element_sizes[i] * count, '\0');
+	}
+	
+	// visibility is a cluster count and row size followed by one bit row per cluster
+	lumps[16] = QByteArray((int)visibility_bytes(), '\xFF');
+	int32_t vis_header[2] { (int32_t)clusters, (int32_t)cluster_bytes() };
+	lumps[16].replace(0, sizeof(vis_header), reinterpret_cast<char const *>(vis_header), sizeof(vis_header));
+	
+	RawBSP::Header header {};
+	std::copy_n("RBSP", 4, header.ident);
+	header.version = 1;
+	QByteArray out { reinterpret_cast<char const *>(&header), sizeof(header) };
+	for (size_t i = 0; i < RawBSP::lump_count; i++) {
+		header.lumps[i].offset = out.size();
+		header.lumps[i].length = lumps[i].size();
+		out.append(lumps[i]);
+		while (out.size() % 4) out.append('\0');
+	}
+	out.replace(0, sizeof(header), reinterpret_cast<char const *>(&header), sizeof(header));
+	return out;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QByteArray>
+
+#include <cstdint>
+
+// parameters of a generated RBSP, every non-entity lump is filled with zeroed elements
+// so all cross-lump indices point at element 0 and stay in range
+struct SyntheticBSP {
+	size_t entities = 10000;
+	size_t fields = 8; // per entity, including classname/targetname/target/origin
+	size_t elements = 10000; // per fixed size lump
+	size_t lightmaps = 16;
+	size_t clusters = 256;
+	uint32_t seed = 1;
+	
+	// rows are padded to 64 bits
+	size_t cluster_bytes() const;
+	// generate() needs this to fit a QByteArray, so larger cluster counts must be rejected up front
+	size_t visibility_bytes() const;
+	
+	QByteArray generate() const;
+};
@@ -0,0 +1,777 @@
+#include "BSPDocument.hh"
+#include "BSPWriter.hh"
+#include "ClassHistogram.hh"
+#include "DiskCache.hh"
+#include "EntityFilter.hh"
+#include "EntityParser.hh"
+#include "EntityTree.hh"
+#include "Lightmaps.hh"
+#include "LumpStats.hh"
+#include "MapCache.hh"
+#include "MappedFile.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "ShaderStats.hh"
+#include "Trace.hh"
+#include "Verify.hh"
+#include "Visibility.hh"
+
+#include <libbsp.hh>
+
+#include <QCheckBox>
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFutureWatcher>
+#include <QFormLayout>
+#include <QGridLayout>
+#include <QGroupBox>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListView>
+#include <QMenu>
+#include <QMessageBox>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QScrollArea>
+#include <QSizePolicy>
+#include <QSortFilterProxyModel>
+#include <QSplitter>
+#include <QTableView>
+#include <QTabWidget>
+#include <QThread>
+#include <QTreeView>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+#include <QtConcurrent>
+
+#include <array>
+#include <atomic>
+
+struct BSPDocument::PrivateData {
+	MapCache & cache;
+	PrivateData(MapCache & cache) : cache { cache } {}
+	
+	// bsp
+	std::shared_ptr<MappedFile> file;
+	RawBSP raw;
+	BSP::Reader bspr;
+	
+	// parsed, null while loading or released to the cache
+	std::shared_ptr<ParsedMap> parsed;
+	bool active = false;
+	bool dirty = false; // edited since opened, never released to the cache again
+	bool unsaved = false;
+	
+	// info
+	std::array<QLabel *, LumpStats::lump_count> general_info_labels {};
+	ClassHistogramModel * class_histogram = nullptr;
+	ShaderStatsModel * shader_stats = nullptr;
+	
+	// lightmaps, read from the mapping on demand rather than by the load pipeline
+	LightmapModel * lightmaps = nullptr;
+	QListView * lightmap_view = nullptr;
+	QLabel * lightmap_page = nullptr;
+	
+	// visibility
+	QLabel * vis_summary = nullptr;
+	QTreeWidget * vis_worst = nullptr;
+	QTreeWidget * vis_histogram = nullptr;
+	
+	// loading
+	// stages after mapping run on a worker, each posts its results back as it completes
+	// results are only accepted from the load matching load_generation
+	QFuture<void> load_job;
+	std::shared_ptr<std::atomic_bool> load_cancel;
+	uint64_t load_generation = 0;
+	bool loading = false;
+	QWidget * load_panel = nullptr;
+	QProgressBar * load_progress = nullptr;
+	std::shared_ptr<Trace::PhaseLog> open_log; // handed from open() to the load pipeline
+	
+	// ents
+	QScrollArea * ent_scroll = nullptr;
+	QLineEdit * ent_filter = nullptr;
+	EntityFilterProxy * ent_filter_proxy = nullptr;
+};
+
+BSPDocument::BSPDocument(MapCache & cache, QWidget * parent) : QWidget { parent }, m_data { new PrivateData { cache } } {
+	
+	auto layout = new QVBoxLayout { this };
+	layout->setMargin(0);
+	
+	auto main_widget = new QTabWidget { this };
+	layout->addWidget(main_widget);
+	
+	m_data->load_panel = new QWidget { this };
+	auto load_layout = new QHBoxLayout { m_data->load_panel };
+	load_layout->setMargin(0);
+	m_data->load_progress = new QProgressBar { m_data->load_panel };
+	m_data->load_progress->setRange(0, 6);
+	m_data->load_progress->setTextVisible(true);
+	auto load_cancel_button = new QPushButton { "Cancel", m_data->load_panel };
+	load_layout->addWidget(m_data->load_progress);
+	load_layout->addWidget(load_cancel_button);
+	layout->addWidget(m_data->load_panel);
+	m_data->load_panel->hide();
+	connect(load_cancel_button, &QPushButton::clicked, this, [this](){
+		cancel_load();
+		emit status_message("Loading cancelled");
+	});
+	
+	// ================================================================
+	// GENERAL TAB
+	// ================================================================
+	{
+	
+		auto tab = new QWidget { main_widget };
+		main_widget->addTab(tab, "General Info");
+		
+		auto tab_layout = new QGridLayout { tab };
+		tab_layout->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+		
+		auto overall_panel = new QGroupBox { "Overall Stats", tab };
+		overall_panel->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
+		auto overall_layout = new QGridLayout { overall_panel };
+		overall_layout->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+		tab_layout->addWidget(overall_panel, 0, 0);
+		
+		auto left_label_gen = [tab](QString str){
+			QLabel * lab = new QLabel {str, tab};
+			lab->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Maximum);
+			lab->setAlignment(Qt::AlignRight | Qt::AlignTop);
+			return lab;
+		};
+		
+		for (size_t i = 0; i < LumpStats::lump_count; i++)
+			overall_layout->addWidget( left_label_gen(QString { LumpStats::names[i] } + ": "), i, 0 );
+		
+		int right_col = 0;
+		for (auto & lab : m_data->general_info_labels) {
+			lab = new QLabel {"", tab};
+			lab->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Maximum);
+			lab->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+			lab->setTextInteractionFlags(Qt::TextSelectableByMouse);
+			overall_layout->addWidget( lab, right_col++, 1 );
+		}
+		
+		auto ents_panel = new QGroupBox { "Entities", tab };
+		tab_layout->addWidget(ents_panel, 0, 1);
+		auto ents_panel_layout = new QGridLayout { ents_panel };
+		ents_panel->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
+		m_data->class_histogram = new ClassHistogramModel { this };
+		auto class_proxy = new QSortFilterProxyModel { ents_panel };
+		class_proxy->setSourceModel(m_data->class_histogram);
+		auto class_view = new QTableView { ents_panel };
+		class_view->setModel(class_proxy);
+		class_view->setSortingEnabled(true);
+		class_view->sortByColumn(0, Qt::AscendingOrder);
+		class_view->setAlternatingRowColors(true);
+		class_view->setSelectionBehavior(QAbstractItemView::SelectRows);
+		class_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+		class_view->verticalHeader()->hide();
+		class_view->verticalHeader()->setDefaultSectionSize(class_view->fontMetrics().height() + 6);
+		class_view->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+		ents_panel_layout->addWidget(class_view, 0, 0);
+	}
+	// ================================================================
+	// SHADER TAB
+	// ================================================================
+	{
+		
+		auto tab = new QWidget { main_widget };
+		main_widget->addTab(tab, "Shaders");
+		auto tab_layout = new QGridLayout { tab };
+		
+		m_data->shader_stats = new ShaderStatsModel { this };
+		auto shader_proxy = new QSortFilterProxyModel { tab };
+		shader_proxy->setSourceModel(m_data->shader_stats);
+		auto shader_view = new QTableView { tab };
+		shader_view->setModel(shader_proxy);
+		shader_view->setSortingEnabled(true);
+		shader_view->sortByColumn(1, Qt::DescendingOrder);
+		shader_view->setAlternatingRowColors(true);
+		shader_view->setSelectionBehavior(QAbstractItemView::SelectRows);
+		shader_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+		shader_view->verticalHeader()->hide();
+		shader_view->verticalHeader()->setDefaultSectionSize(shader_view->fontMetrics().height() + 6);
+		shader_view->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+		tab_layout->addWidget(shader_view, 0, 0);
+	}
+	// ================================================================
+	// LIGHTMAP TAB
+	// ================================================================
+	{
+		
+		auto tab = new QSplitter { main_widget };
+		main_widget->addTab(tab, "Lightmaps");
+		
+		m_data->lightmaps = new LightmapModel { this };
+		m_data->lightmap_view = new QListView { tab };
+		m_data->lightmap_view->setModel(m_data->lightmaps);
+		m_data->lightmap_view->setViewMode(QListView::IconMode);
+		m_data->lightmap_view->setIconSize({ LightmapModel::thumbnail_size, LightmapModel::thumbnail_size });
+		m_data->lightmap_view->setUniformItemSizes(true); // lets the view skip asking off-screen rows for their size
+		m_data->lightmap_view->setResizeMode(QListView::Adjust);
+		m_data->lightmap_view->setMovement(QListView::Static);
+		m_data->lightmap_view->setSelectionMode(QAbstractItemView::SingleSelection);
+		tab->addWidget(m_data->lightmap_view);
+		
+		auto page_panel = new QWidget { tab };
+		auto page_layout = new QVBoxLayout { page_panel };
+		auto overbright_check = new QCheckBox { "Overbright", page_panel };
+		overbright_check->setChecked(m_data->lightmaps->overbright());
+		page_layout->addWidget(overbright_check);
+		auto page_scroll = new QScrollArea { page_panel };
+		m_data->lightmap_page = new QLabel { page_scroll };
+		m_data->lightmap_page->setAlignment(Qt::AlignCenter);
+		page_scroll->setWidget(m_data->lightmap_page);
+		page_scroll->setWidgetResizable(true);
+		page_layout->addWidget(page_scroll);
+		tab->addWidget(page_panel);
+		
+		auto request_current = [this](){
+			QModelIndex current = m_data->lightmap_view->currentIndex();
+			if (current.isValid()) m_data->lightmaps->request_page(current.row());
+		};
+		connect(m_data->lightmap_view->selectionModel(), &QItemSelectionModel::currentChanged, this, request_current);
+		connect(overbright_check, &QCheckBox::toggled, this, [this, request_current](bool checked){
+			m_data->lightmaps->set_overbright(checked);
+			request_current();
+		});
+		connect(m_data->lightmaps, &LightmapModel::page_ready, this, [this](int row, QImage const & image){
+			if (m_data->lightmap_view->currentIndex().row() != row) return;
+			constexpr int zoom = 4;
+			m_data->lightmap_page->setPixmap( QPixmap::fromImage(image.scaled(image.size() * zoom, Qt::KeepAspectRatio, Qt::FastTransformation)) );
+		});
+	}
+	// ================================================================
+	// VISIBILITY TAB
+	// ================================================================
+	{
+		
+		auto tab = new QWidget { main_widget };
+		main_widget->addTab(tab, "Visibility");
+		auto tab_layout = new QGridLayout { tab };
+		
+		m_data->vis_summary = new QLabel { tab };
+		m_data->vis_summary->setTextInteractionFlags(Qt::TextSelectableByMouse);
+		tab_layout->addWidget(m_data->vis_summary, 0, 0, 1, 2);
+		
+		m_data->vis_worst = new QTreeWidget { tab };
+		m_data->vis_worst->setHeaderLabels({ "Cluster", "Visible Clusters", "Fraction" });
+		m_data->vis_worst->setRootIsDecorated(false);
+		tab_layout->addWidget(m_data->vis_worst, 1, 0);
+		
+		m_data->vis_histogram = new QTreeWidget { tab };
+		m_data->vis_histogram->setHeaderLabels({ "Clusters Visible", "Leafs" });
+		m_data->vis_histogram->setRootIsDecorated(false);
+		tab_layout->addWidget(m_data->vis_histogram, 1, 1);
+	}
+	// ================================================================
+	// ENTITY TAB
+	// ================================================================
+	{
+		
+		auto tab = new QWidget { main_widget };
+		main_widget->addTab(tab, "Entities");
+		auto tab_layout = new QGridLayout { tab };
+		
+		auto filter_widget = new QWidget { tab };
+		auto filter_layout = new QHBoxLayout { filter_widget };
+		filter_layout->setMargin(0);
+		m_data->ent_filter = new QLineEdit { filter_widget };
+		filter_layout->addWidget(new QLabel { "Filter: ", filter_widget });
+		filter_layout->addWidget(m_data->ent_filter);
+		tab_layout->addWidget(filter_widget, 0, 0);
+		
+		m_data->ent_scroll = new QScrollArea { tab };
+		tab_layout->addWidget(m_data->ent_scroll, 1, 0);
+		m_data->ent_scroll->setWidgetResizable(true);
+	}
+	// ================================================================
+}
+
+BSPDocument::~BSPDocument() {
+	cancel_load();
+	m_data->load_job.waitForFinished(); // the worker reads from the mapping
+	m_data->active = false;
+	release();
+}
+
+bool BSPDocument::open(QFileInfo file_info, QString & error) {
+	m_data->open_log = std::make_shared<Trace::PhaseLog>("Open");
+	Trace::Scope trace { "map file", m_data->open_log };
+	
+	m_data->file = MappedFile::open(file_info.filePath(), error);
+	if (!m_data->file) return false;
+	if (!m_data->raw.rebase(m_data->file->data(), m_data->file->size())) {
+		error = "Specified file is not a valid BSP.";
+		m_data->file.reset();
+		return false;
+	}
+	m_data->bspr.rebase(m_data->file->data());
+	m_data->lightmaps->set_source(m_data->file, m_data->raw);
+	
+	if (auto parsed = m_data->cache.get(m_data->file->key())) {
+		m_data->parsed = parsed;
+		m_data->active = true;
+		install_model();
+		emit status_message("Open: from cache");
+		m_data->open_log.reset();
+		return true;
+	}
+	m_data->active = true;
+	load();
+	return true;
+}
+
+QString BSPDocument::path() const {
+	return m_data->file ? m_data->file->path() : QString {};
+}
+
+bool BSPDocument::unsaved() const {
+	return m_data->unsaved;
+}
+
+void BSPDocument::set_active(bool active) {
+	if (active == m_data->active) return;
+	m_data->active = active;
+	if (active) acquire();
+	else release();
+}
+
+void BSPDocument::acquire() {
+	if (m_data->parsed || m_data->loading || !m_data->file) return;
+	if (auto parsed = m_data->cache.get(m_data->file->key())) {
+		m_data->parsed = parsed;
+		install_model();
+		return;
+	}
+	load();
+}
+
+void BSPDocument::release() {
+	// decoded lightmaps are cheap to redo, they go regardless of edits
+	if (!m_data->active) {
+		m_data->lightmap_view->clearSelection();
+		m_data->lightmap_view->setCurrentIndex({});
+		m_data->lightmap_page->clear();
+		m_data->lightmaps->clear_cache();
+	}
+	if (m_data->active || m_data->dirty || m_data->loading || !m_data->parsed) return;
+	
+	// views must let go of the model before the cache is free to evict it
+	delete m_data->ent_scroll->takeWidget();
+	m_data->ent_filter_proxy = nullptr;
+	m_data->class_histogram->set_histogram({});
+	m_data->shader_stats->set_stats({});
+	show_visibility(nullptr);
+	m_data->vis_summary->clear();
+	disconnect(m_data->parsed->model.get(), nullptr, this, nullptr);
+	
+	m_data->cache.put(m_data->file->key(), std::move(m_data->parsed));
+	m_data->parsed.reset();
+}
+
+void BSPDocument::save(QString file_path) {
+	if (m_data->loading || !m_data->parsed) {
+		QMessageBox::critical(this, "Save Failed", "The map is still loading.");
+		return;
+	}
+	auto log = std::make_shared<Trace::PhaseLog>("Save");
+	BSPWriter writer { m_data->raw };
+	auto model = m_data->parsed->model;
+	writer.replace(RBSP::ENTITIES, [model, log](QIODevice & dev){
+		Trace::Scope trace { "serialize entities", log };
+		return model->write_entities(dev);
+	});
+	QString error;
+	bool written;
+	{
+		Trace::Scope trace { "write", log };
+		written = writer.write(file_path, error);
+	}
+	if (!written) {
+		QMessageBox::critical(this, "Save Failed", error);
+		return;
+	}
+	m_data->unsaved = false;
+	emit status_message(log->summary());
+}
+
+void BSPDocument::find_replace() {
+	if (!m_data->parsed || m_data->loading) return;
+	
+	QDialog dialog { this };
+	dialog.setWindowTitle("Find and Replace");
+	auto layout = new QFormLayout { &dialog };
+	auto find_edit = new QLineEdit { &dialog };
+	auto replace_edit = new QLineEdit { &dialog };
+	auto keys_edit = new QLineEdit { &dialog };
+	keys_edit->setPlaceholderText("all keys, or comma separated e.g. target, targetname");
+	auto regex_check = new QCheckBox { "Regular expression", &dialog };
+	auto case_check = new QCheckBox { "Case sensitive", &dialog };
+	auto in_keys_check = new QCheckBox { "Replace in keys", &dialog };
+	auto in_values_check = new QCheckBox { "Replace in values", &dialog };
+	in_values_check->setChecked(true);
+	auto buttons = new QDialogButtonBox { QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog };
+	layout->addRow("Find: ", find_edit);
+	layout->addRow("Replace: ", replace_edit);
+	layout->addRow("Only Keys: ", keys_edit);
+	layout->addRow(regex_check);
+	layout->addRow(case_check);
+	layout->addRow(in_keys_check);
+	layout->addRow(in_values_check);
+	layout->addRow(buttons);
+	connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+	connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+	if (dialog.exec() != QDialog::Accepted) return;
+	
+	EntityBulkReplace op;
+	op.find = find_edit->text();
+	op.replace = replace_edit->text();
+	op.regex = regex_check->isChecked();
+	op.case_sensitive = case_check->isChecked();
+	op.keys = in_keys_check->isChecked();
+	op.values = in_values_check->isChecked();
+	for (auto const & key : keys_edit->text().split(',', Qt::SkipEmptyParts))
+		op.only_keys.append(key.trimmed());
+	
+	EntityBulkReplaceResult res = m_data->parsed->model->replace_all(op);
+	if (!res.errors.isEmpty()) {
+		QMessageBox::critical(this, "Replace Failed", "No changes were made:\n" + res.errors.join('\n'));
+		return;
+	}
+	emit status_message(QString { "Replaced %1 fields in %2 entities" }.arg(res.fields).arg(res.entities));
+}
+
+void BSPDocument::cancel_load() {
+	if (m_data->load_cancel) *m_data->load_cancel = true;
+	m_data->load_cancel.reset();
+	m_data->load_generation++;
+	m_data->loading = false;
+	m_data->load_panel->hide();
+}
+
+void BSPDocument::install_model() {
+	Trace::Scope trace { "install model", m_data->open_log };
+	ParsedMap const & parsed = *m_data->parsed;
+	
+	for (size_t i = 0; i < LumpStats::lump_count; i++)
+		m_data->general_info_labels[i]->setText( QString::number(parsed.stats.counts[i]) );
+	if (!parsed.stats.has_visibility)
+		m_data->general_info_labels[16]->setText( "no visibility data" );
+	m_data->class_histogram->set_histogram(parsed.classes);
+	m_data->shader_stats->set_stats(parsed.shaders);
+	show_visibility(parsed.visibility ? &*parsed.visibility : nullptr);
+	
+	QTreeView * ent_view = new QTreeView { };
+	m_data->ent_filter_proxy = new EntityFilterProxy { ent_view };
+	m_data->ent_filter_proxy->setSourceModel(parsed.model.get());
+	ent_view->setModel(m_data->ent_filter_proxy);
+	m_data->ent_scroll->setWidget(ent_view);
+	m_data->ent_scroll->show();
+	ent_view->setColumnWidth(0, 200);
+	ent_view->setColumnWidth(1, 200);
+	ent_view->setSortingEnabled(true);
+	ent_view->sortByColumn(0, Qt::AscendingOrder);
+	ent_view->setContextMenuPolicy(Qt::CustomContextMenu);
+	connect(ent_view, &QWidget::customContextMenuRequested, this, &BSPDocument::entity_context_menu);
+	m_data->ent_filter_proxy->set_filter_text(m_data->ent_filter->text());
+	connect(m_data->ent_filter, &QLineEdit::textChanged, m_data->ent_filter_proxy, &EntityFilterProxy::set_filter_text);
+	
+	// edited state pins itself, the cache only ever holds maps as they are on disk
+	auto mark_dirty = [this](){
+		m_data->unsaved = true;
+		if (m_data->dirty) return;
+		m_data->dirty = true;
+		m_data->cache.remove(m_data->file->key());
+	};
+	connect(parsed.model.get(), &QAbstractItemModel::dataChanged, this, mark_dirty);
+	connect(parsed.model.get(), &QAbstractItemModel::layoutChanged, this, mark_dirty);
+}
+
+void BSPDocument::entity_context_menu(QPoint const & pos) {
+	auto view = qobject_cast<QTreeView *>(m_data->ent_scroll->widget());
+	if (!view || !m_data->parsed) return;
+	EntityTreeModel const & model = *m_data->parsed->model;
+	auto entity = model.entity_of(m_data->ent_filter_proxy->mapToSource(view->indexAt(pos)));
+	if (!entity) return;
+	
+	auto describe = [&](EntityLinks::Reference const & ref, bool show_name){
+		QString text = QString::fromUtf8(ref.key.data(), ref.key.size());
+		if (show_name) text += " \u2192 " + QString::fromStdString(ref.name);
+		if (ref.entity == EntityLinks::no_entity) return text + " (missing)";
+		QString classname = model.index(ref.entity, 1).data().toString();
+		return text + QString { " (entity %1%2)" }.arg(ref.entity).arg(classname.isEmpty() ? QString {} : ", " + classname);
+	};
+	
+	QMenu menu { view };
+	auto menu_targets = menu.addMenu("Jump to Target");
+	for (auto const & ref : model.links().targets_of(*entity)) {
+		auto action = menu_targets->addAction(describe(ref, true));
+		if (ref.entity == EntityLinks::no_entity) action->setEnabled(false);
+		else connect(action, &QAction::triggered, this, [this, target = ref.entity](){ jump_to_entity(target); });
+	}
+	menu_targets->setEnabled(!menu_targets->isEmpty());
+	auto menu_referrers = menu.addMenu("Targeted By");
+	for (auto const & ref : model.links().targeted_by(*entity)) {
+		auto action = menu_referrers->addAction(describe(ref, false));
+		connect(action, &QAction::triggered, this, [this, referrer = ref.entity](){ jump_to_entity(referrer); });
+	}
+	menu_referrers->setEnabled(!menu_referrers->isEmpty());
+	menu.addSeparator();
+	connect(menu.addAction("Reference Report..."), &QAction::triggered, this, &BSPDocument::reference_report);
+	menu.exec(view->viewport()->mapToGlobal(pos));
+}
+
+void BSPDocument::jump_to_entity(size_t entity) {
+	auto view = qobject_cast<QTreeView *>(m_data->ent_scroll->widget());
+	if (!view || !m_data->parsed) return;
+	QModelIndex source = m_data->parsed->model->index(entity, 0);
+	QModelIndex index = m_data->ent_filter_proxy->mapFromSource(source);
+	if (!index.isValid()) {
+		m_data->ent_filter->clear(); // clearing the filter applies immediately
+		index = m_data->ent_filter_proxy->mapFromSource(source);
+	}
+	if (!index.isValid()) return;
+	view->setCurrentIndex(index);
+	view->expand(index);
+	view->scrollTo(index, QAbstractItemView::PositionAtCenter);
+	view->setFocus();
+}
+
+void BSPDocument::reference_report() {
+	if (!m_data->parsed || m_data->loading) return;
+	auto log = std::make_shared<Trace::PhaseLog>("Reference report");
+	EntityLinks::Report report;
+	{
+		Trace::Scope trace { "report", log };
+		report = m_data->parsed->model->links().report();
+	}
+	
+	auto dialog = new QDialog { this };
+	dialog->setAttribute(Qt::WA_DeleteOnClose);
+	dialog->setWindowTitle("Reference Report");
+	dialog->resize(600, 400);
+	auto layout = new QVBoxLayout { dialog };
+	auto tree = new QTreeWidget { dialog };
+	tree->setHeaderLabels({ "Entity", "Key", "Name" });
+	tree->setColumnWidth(0, 150);
+	layout->addWidget(tree);
+	
+	auto dangling = new QTreeWidgetItem { tree, { QString { "Dangling references (%1)" }.arg(report.dangling.size()) } };
+	for (auto const & ref : report.dangling) {
+		auto item = new QTreeWidgetItem { dangling, { QString::number(ref.entity), QString::fromUtf8(ref.key.data(), ref.key.size()), QString::fromStdString(ref.name) } };
+		item->setData(0, Qt::UserRole, ref.entity);
+	}
+	auto duplicates = new QTreeWidgetItem { tree, { QString { "Duplicate targetnames (%1)" }.arg(report.duplicates.size()) } };
+	for (auto const & [name, ents] : report.duplicates) {
+		auto group = new QTreeWidgetItem { duplicates, { QString { "%1 entities" }.arg(ents.size()), "targetname", QString::fromStdString(name) } };
+		for (uint32_t e : ents) {
+			auto item = new QTreeWidgetItem { group, { QString::number(e), "targetname", QString::fromStdString(name) } };
+			item->setData(0, Qt::UserRole, e);
+		}
+	}
+	dangling->setExpanded(true);
+	duplicates->setExpanded(true);
+	
+	// the report is a snapshot, entity indices stay valid as edits never add or remove entities
+	connect(tree, &QTreeWidget::itemDoubleClicked, this, [this](QTreeWidgetItem * item){
+		QVariant entity = item->data(0, Qt::UserRole);
+		if (entity.isValid()) jump_to_entity(entity.toUInt());
+	});
+	dialog->show();
+	emit status_message(log->summary());
+}
+
+void BSPDocument::verify() {
+	if (!m_data->file) return;
+	emit status_message("Verifying...");
+	auto log = std::make_shared<Trace::PhaseLog>("Verify");
+	std::shared_ptr<MappedFile> file = m_data->file; // keeps the mapping alive for the worker
+	RawBSP raw = m_data->raw;
+	
+	auto watcher = new QFutureWatcher<Verify::Report> { this };
+	connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, log](){
+		watcher->deleteLater();
+		Verify::Report report = watcher->result();
+		
+		auto dialog = new QDialog { this };
+		dialog->setAttribute(Qt::WA_DeleteOnClose);
+		dialog->setWindowTitle("Verify");
+		dialog->resize(700, 400);
+		auto layout = new QVBoxLayout { dialog };
+		auto tree = new QTreeWidget { dialog };
+		tree->setHeaderLabels({ "Lump", "Checked", "Violations" });
+		tree->setColumnWidth(0, 300);
+		layout->addWidget(tree);
+		for (auto const & lump : report.lumps) {
+			auto item = new QTreeWidgetItem { tree, { LumpStats::names[lump.lump], QString::number(lump.checked), QString::number(lump.violations) } };
+			for (auto const & v : lump.first)
+				new QTreeWidgetItem { item, { QString { "[%1] %2" }.arg(v.element).arg(QString::fromStdString(v.message)) } };
+			if (lump.violations > lump.first.size())
+				new QTreeWidgetItem { item, { QString { "... %1 more" }.arg(lump.violations - lump.first.size()) } };
+			item->setExpanded(lump.violations);
+		}
+		dialog->show();
+		
+		size_t violations = report.violations();
+		emit status_message((violations ? QString { "%1 violations" }.arg(violations) : QString { "No violations" }) + ", " + log->summary());
+	});
+	watcher->setFuture(QtConcurrent::run([file, raw, log](){
+		Trace::Scope trace { "check references", log };
+		return Verify::run(raw);
+	}));
+}
+
+void BSPDocument::show_visibility(Visibility::Analysis const * analysis) {
+	m_data->vis_worst->clear();
+	m_data->vis_histogram->clear();
+	if (!analysis) {
+		m_data->vis_summary->setText("No visibility data.");
+		return;
+	}
+	m_data->vis_summary->setText(QString { "%1 clusters, each sees %2 minimum, %3 mean, %4 maximum" }
+		.arg(analysis->clusters).arg(analysis->min).arg(analysis->mean, 0, 'f', 1).arg(analysis->max));
+	for (uint32_t cluster : analysis->worst) {
+		uint32_t visible = analysis->visible[cluster];
+		QString fraction = QString::number(100.0 * visible / analysis->clusters, 'f', 1) + '%';
+		new QTreeWidgetItem { m_data->vis_worst, { QString::number(cluster), QString::number(visible), fraction } };
+	}
+	size_t buckets = Visibility::Analysis::histogram_buckets;
+	for (size_t i = 0; i < buckets; i++) {
+		QString range = QString { "%1-%2%" }.arg(i * 100 / buckets).arg((i + 1) * 100 / buckets);
+		new QTreeWidgetItem { m_data->vis_histogram, { range, QString::number(analysis->leaf_histogram[i]) } };
+	}
+	new QTreeWidgetItem { m_data->vis_histogram, { "opaque", QString::number(analysis->opaque_leafs) } };
+}
+
+void BSPDocument::load() {
+	
+	cancel_load();
+	m_data->load_job.waitForFinished();
+	
+	for (auto & lab : m_data->general_info_labels) lab->setText("...");
+	m_data->class_histogram->set_histogram({});
+	m_data->shader_stats->set_stats({});
+	show_visibility(nullptr);
+	m_data->vis_summary->clear();
+	m_data->loading = true;
+	m_data->load_progress->setValue(0);
+	m_data->load_progress->setFormat("Parsing entities");
+	m_data->load_panel->show();
+	
+	auto log = m_data->open_log ? m_data->open_log : std::make_shared<Trace::PhaseLog>("Load");
+	m_data->open_log.reset();
+	auto cancel = m_data->load_cancel = std::make_shared<std::atomic_bool>(false);
+	uint64_t generation = m_data->load_generation;
+	BSP::Reader * bspr = &m_data->bspr; // not touched by the GUI thread while loading
+	std::shared_ptr<MappedFile> file = m_data->file;
+	RawBSP raw = m_data->raw;
+	QThread * gui_thread = this->thread();
+	auto parsed = std::make_shared<ParsedMap>();
+	
+	// run on the GUI thread, unless this load has been cancelled or superseded
+	auto post = [this, generation](auto fn) {
+		QMetaObject::invokeMethod(this, [this, generation, fn](){
+			if (generation == m_data->load_generation) fn();
+		}, Qt::QueuedConnection);
+	};
+	auto progress = [this, post](int stage, QString text) {
+		post([this, stage, text](){
+			m_data->load_progress->setValue(stage);
+			m_data->load_progress->setFormat(text);
+		});
+	};
+	
+	m_data->load_job = QtConcurrent::run([=, this](){
+		
+		// a snapshot on disk stands in for parsing, counting and the histogram
+		// the entity store is shared with the model from here on, edits made while the disk cache
+		// is still being written detach the model from it
+		std::shared_ptr<EntityStore> ents;
+		bool from_disk = false;
+		{
+			Trace::Scope trace { "disk cache", log };
+			if (auto snapshot = DiskCache::load(*file, raw)) {
+				ents = std::move(snapshot->entities);
+				parsed->stats = snapshot->stats;
+				parsed->classes = std::move(snapshot->classes);
+				from_disk = true;
+			}
+		}
+		std::string parse_warning; // reported with the load summary
+		if (!from_disk) {
+			Trace::Scope trace { "parse entities", log };
+			ents = EntityParser::parse_map(file, raw, *bspr, parse_warning);
+		}
+		if (*cancel) return;
+		progress(1, "Counting lumps");
+		
+		if (!from_disk) {
+			Trace::Scope trace { "count lumps", log };
+			parsed->stats = LumpStats::compute(*bspr, ents->entity_count());
+		}
+		post([this, stats = parsed->stats](){
+			for (size_t i = 0; i < LumpStats::lump_count; i++)
+				m_data->general_info_labels[i]->setText( QString::number(stats.counts[i]) );
+			if (!stats.has_visibility)
+				m_data->general_info_labels[16]->setText( "no visibility data" );
+		});
+		if (*cancel) return;
+		progress(2, "Counting classnames");
+		
+		if (!from_disk) {
+			Trace::Scope trace { "count classnames", log };
+			parsed->classes = ClassHistogramModel::compute(*ents);
+		}
+		post([this, classes = parsed->classes](){
+			m_data->class_histogram->set_histogram(classes);
+		});
+		if (*cancel) return;
+		progress(3, "Counting shader usage");
+		
+		// straight from the lumps, so not worth keeping on disk
+		{
+			Trace::Scope trace { "count shader usage", log };
+			parsed->shaders = ShaderStatsModel::compute(raw);
+		}
+		post([this, shaders = parsed->shaders](){
+			m_data->shader_stats->set_stats(shaders);
+		});
+		if (*cancel) return;
+		progress(4, "Analyzing visibility");
+		
+		{
+			Trace::Scope trace { "analyze visibility", log };
+			parsed->visibility = Visibility::analyze(raw);
+		}
+		post([this, visibility = parsed->visibility](){
+			show_visibility(visibility ? &*visibility : nullptr);
+		});
+		if (*cancel) return;
+		progress(5, "Building entity tree");
+		
+		{
+			Trace::Scope trace { "build model", log };
+			parsed->model.reset( new EntityTreeModel { ents } );
+		}
+		parsed->model->moveToThread(gui_thread); // dropped posts release it on the GUI thread
+		post([this, parsed, log, warning = QString::fromStdString(parse_warning)](){
+			m_data->parsed = parsed;
+			m_data->open_log = log;
+			install_model();
+			m_data->open_log.reset();
+			
+			m_data->loading = false;
+			m_data->load_panel->hide();
+			emit status_message(warning.isEmpty() ? log->summary() : warning + "; " + log->summary());
+			release(); // in case the document was switched away from while loading
+		});
+		
+		if (!from_disk) DiskCache::store(*file, raw, parsed->stats, parsed->classes, *ents);
+	});
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QFileInfo>
+#include <QWidget>
+
+#include <memory>
+
+class MapCache;
+namespace Visibility { struct Analysis; }
+
+// one open map in the workspace, with its own mapping, reader and tabs
+// parsed state is only held while the document is active or edited, otherwise it is handed to the cache
+class BSPDocument : public QWidget {
+	Q_OBJECT
+public:
+	
+	BSPDocument(MapCache & cache, QWidget * parent = nullptr);
+	~BSPDocument();
+	
+	// maps the file, then fills in from the cache or starts the load pipeline, false with error on failure
+	bool open(QFileInfo file, QString & error);
+	QString path() const;
+	// edited since opened or last saved
+	bool unsaved() const;
+	
+	void set_active(bool active);
+	
+public slots:
+	void save(QString file);
+	void find_replace();
+	// dangling references and shared targetnames, double clicking an entry jumps to its entity
+	void reference_report();
+	// checks cross-lump references on a worker and lists violations per lump
+	void verify();
+	
+signals:
+	void status_message(QString message);
+	
+private:
+	struct PrivateData;
+	std::unique_ptr<PrivateData> m_data;
+	
+	// runs the load pipeline over the mapped file on a worker, filling tabs as stages complete
+	void load();
+	void cancel_load();
+	void install_model();
+	// fills the visibility tab, null for a map without visibility data
+	void show_visibility(Visibility::Analysis const * analysis);
+	void entity_context_menu(QPoint const & pos);
+	// selects the entity in the entity tab, clearing the filter if it hides it
+	void jump_to_entity(size_t entity);
+	void acquire();
+	void release();
+};
@@ -3,6 +3,9 @@
 #include <QMainWindow>
 #include <QFileInfo>
 
+class BSPDocument;
+
+// workspace of open maps, one tab each
 class BSPReaderWindow : public QMainWindow {
 	Q_OBJECT
 public:
@@ -10,13 +13,18 @@ public:
 	BSPReaderWindow();
 	~BSPReaderWindow();
 	
+	BSPDocument * current_document() const;
+	
 public slots:
+	// opens a new tab, or switches to the tab already showing the file
 	void open(QFileInfo file);
 	void save(QString file);
+	// closes the current tab
 	void close();
-	void init_bsp_info();
 	
 private:
 	struct PrivateData;
 	std::unique_ptr<PrivateData> m_data;
+	
+	bool close_document(int index);
 };
@@ -0,0 +1,72 @@
+#include "BSPWriter.hh"
+#include "Trace.hh"
+
+#include <QSaveFile>
+
+bool BSPWriter::write(QString const & path, QString & error) const {
+	if (!m_source.data()) {
+		error = "No source BSP.";
+		return false;
+	}
+	
+	Trace::Scope trace { "write bsp" };
+	QSaveFile f { path };
+	if (!f.open(QIODevice::WriteOnly)) {
+		error = "Unable to create or open specified file for writing.";
+		return false;
+	}
+	
+	RawBSP::Header header = m_source.header();
+	
+	// header is written once up front for its size, then again once lump extents are known
+	auto write_header = [&](){
+		return f.write(reinterpret_cast<char const *>(&header), sizeof(header)) == sizeof(header);
+	};
+	
+	if (!write_header()) {
+		error = "Failed to write header.";
+		return false;
+	}
+	
+	static constexpr char padding[4] {};
+	for (size_t i = 0; i < RawBSP::lump_count; i++) {
+		qint64 start = f.pos();
+		if (m_replaced[i]) {
+			if (!m_replaced[i](f)) {
+				error = QString { "Failed to serialize lump %1." }.arg(i);
+				return false;
+			}
+		} else {
+			auto src = m_source.lump(i);
+			if (f.write(reinterpret_cast<char const *>(src.data()), src.size()) != (qint64)src.size()) {
+				error = QString { "Failed to write lump %1." }.arg(i);
+				return false;
+			}
+		}
+		qint64 length = f.pos() - start;
+		if (start + length > INT32_MAX) {
+			error = "Output exceeds the maximum BSP size.";
+			return false;
+		}
+		header.lumps[i].offset = start;
+		header.lumps[i].length = length;
+		
+		qint64 pad = (4 - length % 4) % 4;
+		if (pad && f.write(padding, pad) != pad) {
+			error = QString { "Failed to write lump %1." }.arg(i);
+			return false;
+		}
+	}
+	
+	if (!f.seek(0) || !write_header()) {
+		error = "Failed to write header.";
+		return false;
+	}
+	
+	Trace::Scope trace_commit { "commit" };
+	if (!f.commit()) {
+		error = "Failed to replace destination file.";
+		return false;
+	}
+	return true;
+}
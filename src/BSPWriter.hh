@@ -0,0 +1,29 @@
+#pragma once
+
+#include "RawBSP.hh"
+
+#include <QString>
+
+#include <functional>
+
+class QIODevice;
+
+// streams a BSP to disk, lumps without a replacement are copied straight from the source mapping
+// output goes to a temporary file that atomically replaces the destination on success,
+// so saving over the mapped source file is safe
+class BSPWriter {
+public:
+	// writes a lump's contents to the device, false on failure
+	using LumpSerializer = std::function<bool(QIODevice &)>;
+	
+	BSPWriter(RawBSP const & source) : m_source { source } {}
+	
+	void replace(size_t lump, LumpSerializer serializer) { m_replaced[lump] = std::move(serializer); }
+	
+	// on failure, error describes the cause
+	bool write(QString const & path, QString & error) const;
+	
+private:
+	RawBSP const & m_source;
+	std::array<LumpSerializer, RawBSP::lump_count> m_replaced {};
+};
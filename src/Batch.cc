@@ -0,0 +1,476 @@
+#include "Batch.hh"
+#include "Diff.hh"
+#include "EntityParser.hh"
+#include "EntityStore.hh"
+#include "LumpStats.hh"
+#include "MappedFile.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+#include "Verify.hh"
+#include "Visibility.hh"
+
+#include <libbsp.hh>
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	
+	enum struct Format { JSON, CSV };
+	
+	struct Job {
+		QString input;
+		QString output_base; // output path without extension
+	};
+	
+	struct Result {
+		bool ok = false;
+		QString error;
+		LumpStats stats;
+		Verify::Report verify;
+		std::optional<Visibility::Analysis> visibility;
+	};
+	
+	QString csv_escape(QString str) {
+		if (!str.contains(',') && !str.contains('"') && !str.contains('\n')) return str;
+		str.replace("\"", "\"\"");
+		return '"' + str + '"';
+	}
+	
+	QString to_qstring(meadow::istring_view str) {
+		return QString::fromStdString( meadow::i2s(str) );
+	}
+	
+	bool write_file(QString const & path, QByteArray const & data) {
+		QFile f { path };
+		if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+		return f.write(data) == data.size();
+	}
+	
+	QJsonValue visibility_json(std::optional<Visibility::Analysis> const & vis) {
+		if (!vis) return QJsonValue {};
+		QJsonArray worst;
+		for (uint32_t cluster : vis->worst)
+			worst.append(QJsonObject { { "cluster", (qint64)cluster }, { "visible", (qint64)vis->visible[cluster] } });
+		QJsonArray histogram;
+		for (size_t leafs : vis->leaf_histogram) histogram.append((qint64)leafs);
+		QJsonObject obj;
+		obj["clusters"] = (qint64)vis->clusters;
+		obj["min"] = (qint64)vis->min;
+		obj["mean"] = vis->mean;
+		obj["max"] = (qint64)vis->max;
+		obj["worst"] = worst;
+		obj["leaf_histogram"] = histogram;
+		obj["opaque_leafs"] = (qint64)vis->opaque_leafs;
+		return obj;
+	}
+	
+	bool write_json(Job const & job, LumpStats const & stats, std::optional<Visibility::Analysis> const & vis, BSP::Reader::EntityArray const & ents) {
+		QJsonObject lumps;
+		for (size_t i = 0; i < LumpStats::lump_count; i++) {
+			if (i == RBSP::VISIBILITY && !stats.has_visibility) lumps[LumpStats::names[i]] = QJsonValue {};
+			else lumps[LumpStats::names[i]] = static_cast<qint64>(stats.counts[i]);
+		}
+		QJsonArray entities;
+		for (auto const & ent : ents) {
+			QJsonObject obj;
+			for (auto const & kvp : ent)
+				obj[to_qstring(kvp.first)] = to_qstring(kvp.second);
+			entities.append(obj);
+		}
+		QJsonObject root;
+		root["file"] = job.input;
+		root["lumps"] = lumps;
+		root["visibility"] = visibility_json(vis);
+		root["entities"] = entities;
+		return write_file(job.output_base + ".json", QJsonDocument { root }.toJson(QJsonDocument::Compact));
+	}
+	
+	bool write_csv(Job const & job, BSP::Reader::EntityArray const & ents) {
+		QByteArray data;
+		QTextStream out { &data, QIODevice::WriteOnly };
+		out << "entity,key,value\n";
+		size_t entity_idx = 0;
+		for (auto const & ent : ents) {
+			for (auto const & kvp : ent)
+				out << entity_idx << ',' << csv_escape(to_qstring(kvp.first)) << ',' << csv_escape(to_qstring(kvp.second)) << '\n';
+			entity_idx++;
+		}
+		out.flush();
+		return write_file(job.output_base + ".entities.csv", data);
+	}
+	
+	Result process(Job const & job, BSP::Reader & bspr, Format format) {
+		Trace::Scope trace { "batch map" };
+		Result res;
+		QFile file { job.input };
+		if (!file.open(QIODevice::ReadOnly)) {
+			res.error = "unable to open file";
+			return res;
+		}
+		uchar * map = file.map(0, file.size(), QFileDevice::MapPrivateOption);
+		if (!map) {
+			res.error = "unable to map file";
+			return res;
+		}
+		RawBSP raw;
+		if (!raw.rebase(map, file.size())) {
+			res.error = "not a valid BSP";
+			return res;
+		}
+		bspr.rebase(map);
+		
+		BSP::Reader::EntityArray ents;
+		{
+			Trace::Scope trace { "parse entities" };
+			ents = bspr.entities_parsed();
+		}
+		res.stats = LumpStats::compute(bspr, ents.size());
+		res.visibility = Visibility::analyze(raw);
+		
+		Trace::Scope trace_write { "write output" };
+		bool written = false;
+		switch (format) {
+			case Format::JSON:
+				written = write_json(job, res.stats, res.visibility, ents);
+				break;
+			case Format::CSV:
+				written = write_csv(job, ents);
+				break;
+		}
+		file.unmap(map);
+		
+		if (!written) {
+			res.error = "unable to write output";
+			return res;
+		}
+		res.ok = true;
+		return res;
+	}
+	
+	Result verify(Job const & job, size_t max_violations) {
+		Trace::Scope trace { "batch verify" };
+		Result res;
+		auto file = MappedFile::open(job.input, res.error);
+		if (!file) return res;
+		RawBSP raw;
+		if (!raw.rebase(file->data(), file->size())) {
+			res.error = "not a valid BSP";
+			return res;
+		}
+		res.verify = Verify::run(raw, max_violations);
+		res.ok = true;
+		return res;
+	}
+	
+	struct DiffJob {
+		QString a, b;
+		QString name; // as reported
+	};
+	
+	struct DiffResult {
+		bool ok = false;
+		QString error;
+		QStringList warnings;
+		Diff::Result diff;
+	};
+	
+	// the entity lump is only parsed when its hash differs, identical maps cost two mappings and a hash pass
+	DiffResult diff(DiffJob const & job, BSP::Reader & bspr_a, BSP::Reader & bspr_b) {
+		Trace::Scope trace { "batch diff" };
+		DiffResult res;
+		QString error;
+		auto file_a = MappedFile::open(job.a, error);
+		auto file_b = file_a ? MappedFile::open(job.b, error) : nullptr;
+		if (!file_b) {
+			res.error = error;
+			return res;
+		}
+		RawBSP raw_a, raw_b;
+		if (!raw_a.rebase(file_a->data(), file_a->size()) || !raw_b.rebase(file_b->data(), file_b->size())) {
+			res.error = "not a valid BSP";
+			return res;
+		}
+		
+		res.diff.lumps = Diff::compare_lumps(raw_a, raw_b);
+		if (res.diff.lumps[RBSP::ENTITIES].differs()) {
+			std::shared_ptr<EntityStore> ents_a, ents_b;
+			{
+				Trace::Scope trace_parse { "parse entities" };
+				std::string warning_a, warning_b;
+				ents_a = EntityParser::parse_map(file_a, raw_a, bspr_a, warning_a);
+				ents_b = EntityParser::parse_map(file_b, raw_b, bspr_b, warning_b);
+				if (!warning_a.empty()) res.warnings.append(job.a + ": " + QString::fromStdString(warning_a));
+				if (!warning_b.empty()) res.warnings.append(job.b + ": " + QString::fromStdString(warning_b));
+			}
+			res.diff.entities = Diff::compare_entities(*ents_a, *ents_b);
+		}
+		res.ok = true;
+		return res;
+	}
+	
+	// relative path -> path, for every *.bsp under dir
+	QMap<QString, QString> scan_maps(QString const & path) {
+		QMap<QString, QString> maps;
+		QDir dir { path };
+		QDirIterator iter { path, { "*.bsp" }, QDir::Files, QDirIterator::Subdirectories };
+		while (iter.hasNext()) {
+			QString file = iter.next();
+			maps.insert(dir.relativeFilePath(file), file);
+		}
+		return maps;
+	}
+	
+	int run_diff(QStringList const & paths, unsigned jobs_count) {
+		QTextStream out { stdout };
+		QTextStream err { stderr };
+		if (paths.size() != 2) {
+			err << "--diff takes exactly two files or two directories\n";
+			return 2;
+		}
+		
+		std::vector<DiffJob> jobs;
+		int unmatched = 0;
+		QFileInfo info_a { paths[0] }, info_b { paths[1] };
+		if (info_a.isDir() != info_b.isDir()) {
+			err << "cannot compare a file with a directory\n";
+			return 2;
+		}
+		if (info_a.isDir()) {
+			auto maps_a = scan_maps(paths[0]), maps_b = scan_maps(paths[1]);
+			for (auto iter = maps_a.cbegin(); iter != maps_a.cend(); iter++) {
+				if (maps_b.contains(iter.key())) jobs.push_back({ iter.value(), maps_b.value(iter.key()), iter.key() });
+				else {
+					out << "only in " << paths[0] << ": " << iter.key() << '\n';
+					unmatched++;
+				}
+			}
+			for (auto iter = maps_b.cbegin(); iter != maps_b.cend(); iter++) {
+				if (maps_a.contains(iter.key())) continue;
+				out << "only in " << paths[1] << ": " << iter.key() << '\n';
+				unmatched++;
+			}
+		} else {
+			jobs.push_back({ paths[0], paths[1], info_b.fileName() });
+		}
+		
+		std::vector<DiffResult> results (jobs.size());
+		std::atomic_size_t next_job { 0 };
+		auto worker = [&](){
+			BSP::Reader bspr_a, bspr_b;
+			for (size_t i = next_job++; i < jobs.size(); i = next_job++)
+				results[i] = diff(jobs[i], bspr_a, bspr_b);
+		};
+		jobs_count = std::min<size_t>(jobs_count, jobs.size());
+		std::vector<std::thread> threads;
+		threads.reserve(jobs_count);
+		for (unsigned i = 0; i < jobs_count; i++) threads.emplace_back(worker);
+		for (auto & t : threads) t.join();
+		
+		// reported in path order, identical maps are only mentioned when comparing a single pair
+		int failures = 0, different = unmatched;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			for (auto const & warning : results[i].warnings) err << warning << '\n';
+			if (!results[i].ok) {
+				err << jobs[i].name << ": " << results[i].error << '\n';
+				failures++;
+				continue;
+			}
+			if (results[i].diff.identical()) {
+				if (jobs.size() == 1) out << jobs[i].name << ": identical\n";
+				continue;
+			}
+			different++;
+			out << "== " << jobs[i].name << '\n' << QString::fromStdString( Diff::format(results[i].diff) );
+		}
+		out.flush();
+		if (jobs.size() > 1) err << different << " of " << (jobs.size() + unmatched) << " maps differ\n";
+		if (failures) return 2;
+		return different ? 1 : 0;
+	}
+	
+	QStringList collect_inputs(QStringList const & paths) {
+		QStringList inputs;
+		for (auto const & path : paths) {
+			QFileInfo info { path };
+			if (info.isDir()) {
+				QDirIterator iter { path, { "*.bsp" }, QDir::Files, QDirIterator::Subdirectories };
+				QStringList found;
+				while (iter.hasNext()) found.append(iter.next());
+				found.sort();
+				inputs.append(found);
+			} else inputs.append(path);
+		}
+		return inputs;
+	}
+}
+
+bool Batch::requested(int argc, char * * argv) {
+	for (int i = 1; i < argc; i++)
+		if (!std::strcmp(argv[i], "--batch") || !std::strcmp(argv[i], "--verify") || !std::strcmp(argv[i], "--diff")) return true;
+	return false;
+}
+
+int Batch::run(QStringList const & args) {
+	
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Extract lump statistics and entities from BSP files without a GUI.");
+	parser.addHelpOption();
+	parser.addOption({ "batch", "Run headless batch mode." });
+	parser.addOption({ "verify", "Check cross-lump references instead of extracting, exits with 1 if any map fails." });
+	parser.addOption({ "diff", "Compare two maps, or two directories of maps by relative path, exits with 1 if anything differs." });
+	parser.addOption({ "max-violations", "Violations listed per lump when verifying (default: 20).", "count", QString::number(Verify::default_max_violations) });
+	parser.addOption({ { "j", "jobs" }, "Number of worker threads (default: all cores).", "count" });
+	parser.addOption({ { "f", "format" }, "Output format, json or csv (default: json).", "format", "json" });
+	parser.addOption({ { "o", "output" }, "Output directory (default: current directory).", "dir", "." });
+	parser.addPositionalArgument("inputs", "BSP files or directories to scan for *.bsp.", "inputs...");
+	parser.process(args);
+	
+	QTextStream err { stderr };
+	
+	Format format;
+	QString format_str = parser.value("format").toLower();
+	if (format_str == "json") format = Format::JSON;
+	else if (format_str == "csv") format = Format::CSV;
+	else {
+		err << "unknown format: " << format_str << '\n';
+		return 2;
+	}
+	
+	unsigned jobs_count = QThread::idealThreadCount();
+	if (parser.isSet("jobs")) {
+		bool ok = false;
+		jobs_count = parser.value("jobs").toUInt(&ok);
+		if (!ok || !jobs_count) {
+			err << "invalid job count: " << parser.value("jobs") << '\n';
+			return 2;
+		}
+	}
+	
+	if (parser.isSet("diff")) return run_diff(parser.positionalArguments(), jobs_count);
+	
+	bool verify_only = parser.isSet("verify");
+	size_t max_violations = Verify::default_max_violations;
+	if (parser.isSet("max-violations")) {
+		bool ok = false;
+		max_violations = parser.value("max-violations").toUInt(&ok);
+		if (!ok) {
+			err << "invalid violation count: " << parser.value("max-violations") << '\n';
+			return 2;
+		}
+	}
+	
+	QDir out_dir { parser.value("output") };
+	if (!verify_only && !out_dir.mkpath(".")) {
+		err << "unable to create output directory: " << out_dir.path() << '\n';
+		return 2;
+	}
+	
+	QStringList inputs = collect_inputs(parser.positionalArguments());
+	if (inputs.isEmpty()) {
+		err << "no input files\n";
+		return 2;
+	}
+	
+	// output names are decided up front so workers never contend on them
+	std::vector<Job> jobs;
+	jobs.reserve(inputs.size());
+	QSet<QString> used_names;
+	for (auto const & input : inputs) {
+		QString base = QFileInfo { input }.completeBaseName();
+		QString name = base;
+		for (int i = 1; used_names.contains(name); i++)
+			name = base + '-' + QString::number(i);
+		used_names.insert(name);
+		jobs.push_back({ input, out_dir.filePath(name) });
+	}
+	
+	std::vector<Result> results (jobs.size());
+	std::atomic_size_t next_job { 0 };
+	
+	auto worker = [&](){
+		BSP::Reader bspr;
+		for (size_t i = next_job++; i < jobs.size(); i = next_job++)
+			results[i] = verify_only ? verify(jobs[i], max_violations) : process(jobs[i], bspr, format);
+	};
+	
+	jobs_count = std::min<size_t>(jobs_count, jobs.size());
+	std::vector<std::thread> threads;
+	threads.reserve(jobs_count);
+	for (unsigned i = 0; i < jobs_count; i++) threads.emplace_back(worker);
+	for (auto & t : threads) t.join();
+	
+	if (verify_only) {
+		QTextStream out { stdout };
+		int failures = 0;
+		for (size_t i = 0; i < jobs.size(); i++) {
+			if (!results[i].ok) {
+				err << jobs[i].input << ": " << results[i].error << '\n';
+				failures++;
+				continue;
+			}
+			size_t violations = results[i].verify.violations();
+			out << jobs[i].input << ": " << (violations ? QString { "%1 violations" }.arg(violations) : "ok") << '\n';
+			if (violations) {
+				out << QString::fromStdString( Verify::format(results[i].verify) );
+				failures++;
+			}
+		}
+		out.flush();
+		err << (jobs.size() - failures) << '/' << jobs.size() << " maps passed\n";
+		return failures ? 1 : 0;
+	}
+	
+	// summary of all maps, in input order
+	QByteArray summary;
+	QTextStream out { &summary, QIODevice::WriteOnly };
+	out << "file";
+	for (auto name : LumpStats::names) out << ',' << csv_escape(name);
+	out << ",Visible Min,Visible Mean,Visible Max\n";
+	
+	int failures = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (!results[i].ok) {
+			err << jobs[i].input << ": " << results[i].error << '\n';
+			failures++;
+			continue;
+		}
+		out << csv_escape(jobs[i].input);
+		for (size_t l = 0; l < LumpStats::lump_count; l++) {
+			out << ',';
+			if (l != RBSP::VISIBILITY || results[i].stats.has_visibility) out << results[i].stats.counts[l];
+		}
+		if (auto const & vis = results[i].visibility)
+			out << ',' << vis->min << ',' << QString::number(vis->mean, 'f', 2) << ',' << vis->max;
+		else
+			out << ",,,";
+		out << '\n';
+	}
+	out.flush();
+	
+	if (!write_file(out_dir.filePath("stats.csv"), summary)) {
+		err << "unable to write summary\n";
+		return 1;
+	}
+	
+	err << (jobs.size() - failures) << '/' << jobs.size() << " maps processed\n";
+	return failures ? 1 : 0;
+}
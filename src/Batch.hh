@@ -0,0 +1,13 @@
+#pragma once
+
+#include <QStringList>
+
+// headless mode: no QApplication, no widgets
+namespace Batch {
+	
+	// true if the command line requests batch mode
+	bool requested(int argc, char * * argv);
+	
+	// returns process exit code
+	int run(QStringList const & args);
+}
@@ -0,0 +1,72 @@
+#include "ClassHistogram.hh"
+#include "Parallel.hh"
+#include "Trace.hh"
+
+#include <map>
+
+ClassHistogramModel::Histogram ClassHistogramModel::compute(EntityStore const & ents) {
+	Trace::Scope trace { "class histogram" };
+	using Counts = std::map<meadow::istring_view, qulonglong>;
+	
+	Counts counts = Parallel::reduce_chunks<Counts>(ents.entity_count(), 1024, [&](Parallel::Range r){
+		Counts part;
+		for (size_t i = r.begin; i < r.end; i++) {
+			auto classname = ents.value_of(i, "classname");
+			if (!classname)
+				part["<no classname>"]++;
+			else
+				part[meadow::istring_view { classname->data(), classname->size() }]++;
+		}
+		return part;
+	}, [](Counts & into, Counts && part){
+		for (auto const & v : part) into[v.first] += v.second;
+	});
+	
+	Histogram histogram;
+	histogram.reserve(counts.size());
+	for (auto const & v : counts)
+		histogram.push_back({ QString::fromStdString( meadow::i2s(v.first) ), v.second });
+	return histogram;
+}
+
+void ClassHistogramModel::set_histogram(Histogram histogram) {
+	beginResetModel();
+	m_histogram = std::move(histogram);
+	endResetModel();
+}
+
+int ClassHistogramModel::rowCount(QModelIndex const & parent) const {
+	if (parent.isValid()) return 0;
+	return m_histogram.size();
+}
+
+int ClassHistogramModel::columnCount(QModelIndex const & parent) const {
+	if (parent.isValid()) return 0;
+	return 2;
+}
+
+QVariant ClassHistogramModel::data(QModelIndex const & index, int role) const {
+	if (!index.isValid() || index.row() >= (int)m_histogram.size()) return {};
+	Entry const & entry = m_histogram[index.row()];
+	switch (role) {
+		default: return {};
+		case Qt::DisplayRole:
+			switch (index.column()) {
+				default: return {};
+				case 0: return entry.classname;
+				case 1: return entry.count;
+			}
+		case Qt::TextAlignmentRole:
+			if (index.column() == 1) return QVariant { Qt::AlignRight | Qt::AlignVCenter };
+			return {};
+	}
+}
+
+QVariant ClassHistogramModel::headerData(int section, Qt::Orientation orientation, int role) const {
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return {};
+	switch (section) {
+		default: return {};
+		case 0: return "Classname";
+		case 1: return "Count";
+	}
+}
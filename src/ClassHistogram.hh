@@ -0,0 +1,36 @@
+#pragma once
+
+#include "EntityStore.hh"
+
+#include <libbsp.hh>
+
+#include <QAbstractTableModel>
+
+#include <vector>
+
+// entity count per classname, for the General Info tab
+class ClassHistogramModel : public QAbstractTableModel {
+	Q_OBJECT
+	
+public:
+	struct Entry {
+		QString classname;
+		qulonglong count;
+	};
+	using Histogram = std::vector<Entry>;
+	
+	ClassHistogramModel(QObject * parent = nullptr) : QAbstractTableModel { parent } {}
+	
+	// parallel over entity chunks, sorted by classname, safe to call from any thread
+	static Histogram compute(EntityStore const & ents);
+	void set_histogram(Histogram histogram);
+	
+	// QAbstractItemModel implementations
+	int rowCount(QModelIndex const & parent = {}) const override;
+	int columnCount(QModelIndex const & parent = {}) const override;
+	QVariant data(QModelIndex const & index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+	
+private:
+	Histogram m_histogram;
+};
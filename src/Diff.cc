@@ -0,0 +1,211 @@
+#include "Diff.hh"
+#include "Format.hh"
+#include "Hash.hh"
+#include "LumpStats.hh"
+#include "Parallel.hh"
+#include "RawBSP.hh"
+#include "Trace.hh"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+	
+	constexpr int64_t unpaired = -1;
+	constexpr int64_t ambiguous = -2;
+	
+	std::string folded(std::string_view str) {
+		std::string out { str };
+		for (char & c : out)
+			if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		return out;
+	}
+	
+	// targetname -> entity, or ambiguous if more than one entity holds it
+	std::unordered_map<std::string, int64_t> unique_names(EntityStore const & store) {
+		std::unordered_map<std::string, int64_t> names;
+		for (size_t e = 0; e < store.entity_count(); e++) {
+			auto name = store.value_of(e, "targetname");
+			if (!name || name->empty()) continue;
+			auto [iter, inserted] = names.emplace(folded(*name), e);
+			if (!inserted) iter->second = ambiguous;
+		}
+		return names;
+	}
+	
+	uint64_t entity_hash(EntityStore const & store, size_t entity) {
+		uint64_t hash = 0;
+		for (auto const & field : store.fields(entity)) {
+			std::string_view key = store.str(field.key), value = store.str(field.value);
+			hash = Hash::hash64(key.data(), key.size(), hash) * 31;
+			hash = Hash::hash64(value.data(), value.size(), hash) * 31;
+		}
+		return hash;
+	}
+	
+	std::vector<Diff::FieldChange> compare_fields(EntityStore const & a, size_t ea, EntityStore const & b, size_t eb) {
+		std::vector<Diff::FieldChange> changes;
+		// a key repeated within an entity keeps its first value, as EntityParser does
+		std::unordered_map<std::string, std::string_view> before;
+		for (auto const & field : a.fields(ea))
+			before.emplace(folded(a.str(field.key)), a.str(field.value));
+		std::unordered_set<std::string> seen;
+		for (auto const & field : b.fields(eb)) {
+			std::string_view key = b.str(field.key), value = b.str(field.value);
+			std::string key_folded = folded(key);
+			if (!seen.insert(key_folded).second) continue;
+			auto iter = before.find(key_folded);
+			if (iter == before.end()) {
+				changes.push_back({ std::string { key }, std::nullopt, std::string { value } });
+				continue;
+			}
+			if (iter->second != value) changes.push_back({ std::string { key }, std::string { iter->second }, std::string { value } });
+			before.erase(iter);
+		}
+		for (auto const & field : a.fields(ea)) {
+			auto iter = before.find(folded(a.str(field.key)));
+			if (iter == before.end()) continue;
+			changes.push_back({ std::string { a.str(field.key) }, std::string { iter->second }, std::nullopt });
+			before.erase(iter);
+		}
+		return changes;
+	}
+}
+
+bool Diff::Result::identical() const {
+	for (auto const & lump : lumps)
+		if (lump.differs()) return false;
+	return entities.empty();
+}
+
+std::vector<Diff::LumpDiff> Diff::compare_lumps(RawBSP const & a, RawBSP const & b) {
+	Trace::Scope trace { "hash lumps" };
+	std::vector<LumpDiff> lumps (RawBSP::lump_count);
+	Parallel::for_chunks(lumps.size(), 1, [&](Parallel::Range r){
+		for (size_t i = r.begin; i < r.end; i++) {
+			auto la = a.lump(i), lb = b.lump(i);
+			lumps[i] = { i, la.size(), lb.size(), Hash::hash64(la.data(), la.size()), Hash::hash64(lb.data(), lb.size()) };
+		}
+	});
+	return lumps;
+}
+
+std::vector<Diff::EntityChange> Diff::compare_entities(EntityStore const & a, EntityStore const & b) {
+	Trace::Scope trace { "diff entities" };
+	size_t na = a.entity_count(), nb = b.entity_count();
+	std::vector<int64_t> pair_a (na, unpaired), pair_b (nb, unpaired);
+	auto pair = [&](size_t ea, size_t eb){
+		pair_a[ea] = eb;
+		pair_b[eb] = ea;
+	};
+	
+	// named entities first, as long as the name is unambiguous on both sides
+	auto names_a = unique_names(a);
+	for (auto const & [name, eb] : unique_names(b)) {
+		if (eb < 0) continue;
+		auto iter = names_a.find(name);
+		if (iter != names_a.end() && iter->second >= 0) pair(iter->second, eb);
+	}
+	
+	// then unchanged entities wherever they moved to, in order for entities that appear more than once
+	std::vector<uint64_t> hash_a (na), hash_b (nb);
+	Parallel::for_chunks(na, 1024, [&](Parallel::Range r){ for (size_t e = r.begin; e < r.end; e++) hash_a[e] = entity_hash(a, e); });
+	Parallel::for_chunks(nb, 1024, [&](Parallel::Range r){ for (size_t e = r.begin; e < r.end; e++) hash_b[e] = entity_hash(b, e); });
+	std::unordered_map<uint64_t, std::vector<size_t>> queues;
+	for (size_t e = na; e-- > 0;)
+		if (pair_a[e] == unpaired) queues[hash_a[e]].push_back(e); // reversed, so back() is the lowest index
+	for (size_t e = 0; e < nb; e++) {
+		if (pair_b[e] != unpaired) continue;
+		auto iter = queues.find(hash_b[e]);
+		if (iter == queues.end() || iter->second.empty()) continue;
+		pair(iter->second.back(), e);
+		iter->second.pop_back();
+	}
+	
+	// whatever is left is taken to be modified if it sits at the same offset from the nearest paired entity
+	// before it on both sides and keeps its classname
+	int64_t anchor_a = -1, anchor_b = -1;
+	for (size_t ea = 0; ea < na; ea++) {
+		if (pair_a[ea] >= 0) {
+			anchor_a = ea;
+			anchor_b = pair_a[ea];
+			continue;
+		}
+		size_t eb = anchor_b + (ea - anchor_a);
+		if (eb >= nb || pair_b[eb] != unpaired) continue;
+		auto class_a = a.value_of(ea, "classname"), class_b = b.value_of(eb, "classname");
+		if (class_a.has_value() != class_b.has_value() || (class_a && !EntityStore::iequals(*class_a, *class_b))) continue;
+		pair(ea, eb);
+		anchor_a = ea;
+		anchor_b = eb;
+	}
+	
+	auto describe = [](EntityChange & change, EntityStore const & store, size_t e){
+		change.classname = store.value_of(e, "classname").value_or("");
+		change.targetname = store.value_of(e, "targetname").value_or("");
+	};
+	
+	std::vector<EntityChange> changes;
+	for (size_t eb = 0; eb < nb; eb++) {
+		if (pair_b[eb] == unpaired) {
+			EntityChange change { EntityChange::Kind::Added, std::nullopt, eb, {}, {}, {} };
+			describe(change, b, eb);
+			changes.push_back(std::move(change));
+			continue;
+		}
+		size_t ea = pair_b[eb];
+		if (hash_a[ea] == hash_b[eb]) continue;
+		auto fields = compare_fields(a, ea, b, eb);
+		if (fields.empty()) continue; // same fields in a different order
+		EntityChange change { EntityChange::Kind::Modified, ea, eb, {}, {}, {} };
+		describe(change, b, eb);
+		change.fields = std::move(fields);
+		changes.push_back(std::move(change));
+	}
+	for (size_t ea = 0; ea < na; ea++) {
+		if (pair_a[ea] != unpaired) continue;
+		EntityChange change { EntityChange::Kind::Removed, ea, std::nullopt, {}, {}, {} };
+		describe(change, a, ea);
+		changes.push_back(std::move(change));
+	}
+	return changes;
+}
+
+std::string Diff::format(Result const & result) {
+	std::string out;
+	for (auto const & lump : result.lumps) {
+		if (!lump.differs()) continue;
+		out += Format::printf("lump %s: %zu -> %zu bytes\n", LumpStats::names[lump.lump], lump.size_a, lump.size_b);
+	}
+	
+	size_t counts[3] {};
+	for (auto const & change : result.entities) counts[static_cast<int>(change.kind)]++;
+	if (!result.entities.empty())
+		out += Format::printf("entities: %zu added, %zu removed, %zu modified\n", counts[0], counts[1], counts[2]);
+	
+	for (auto const & change : result.entities) {
+		std::string id = change.classname;
+		if (!change.targetname.empty()) id += " \"" + change.targetname + '"';
+		switch (change.kind) {
+			case EntityChange::Kind::Added:
+				out += Format::printf("  + #%zu ", *change.index_b) + id + '\n';
+				break;
+			case EntityChange::Kind::Removed:
+				out += Format::printf("  - #%zu ", *change.index_a) + id + '\n';
+				break;
+			case EntityChange::Kind::Modified:
+				out += (*change.index_a == *change.index_b ?
+					Format::printf("  ~ #%zu ", *change.index_b) :
+					Format::printf("  ~ #%zu -> #%zu ", *change.index_a, *change.index_b)) + id + '\n';
+				for (auto const & field : change.fields) {
+					out += "      " + field.key + ": ";
+					out += field.before ? '"' + *field.before + '"' : std::string { "(none)" };
+					out += " -> ";
+					out += field.after ? '"' + *field.after + '"' : std::string { "(none)" };
+					out += '\n';
+				}
+				break;
+		}
+	}
+	return out;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "EntityStore.hh"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct RawBSP;
+
+// differences between two builds of a map: which lumps changed, and for the entity lump, which entities
+namespace Diff {
+	
+	struct LumpDiff {
+		size_t lump;
+		size_t size_a, size_b;
+		uint64_t hash_a, hash_b;
+		bool differs() const { return size_a != size_b || hash_a != hash_b; }
+	};
+	
+	struct FieldChange {
+		std::string key;
+		std::optional<std::string> before; // none if added
+		std::optional<std::string> after; // none if removed
+	};
+	
+	struct EntityChange {
+		enum struct Kind { Added, Removed, Modified };
+		Kind kind;
+		std::optional<size_t> index_a, index_b;
+		std::string classname;
+		std::string targetname;
+		std::vector<FieldChange> fields; // only for Modified
+	};
+	
+	struct Result {
+		std::vector<LumpDiff> lumps;
+		std::vector<EntityChange> entities;
+		bool identical() const;
+	};
+	
+	// hashes every lump of both maps in parallel
+	std::vector<LumpDiff> compare_lumps(RawBSP const & a, RawBSP const & b);
+	
+	// entities are paired by unique targetname, then identical content, then position relative to paired neighbours,
+	// so inserting or removing an entity doesn't show every following one as modified
+	// changes come in b's entity order, followed by removals in a's order
+	std::vector<EntityChange> compare_entities(EntityStore const & a, EntityStore const & b);
+	
+	std::string format(Result const & result);
+}
@@ -0,0 +1,239 @@
+#include "DiskCache.hh"
+#include "Hash.hh"
+#include "MappedFile.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	
+	constexpr char magic[8] { 'B', 'S', 'P', 'I', 'U', 'M', 'C', '\0' };
+	constexpr uint32_t format_version = 2;
+	
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t has_visibility;
+		uint64_t content_hash;
+		int64_t counts[LumpStats::lump_count];
+		uint32_t class_count;
+		uint32_t entity_count;
+	};
+	
+	// covers everything a snapshot is derived from: the lump directory for the counts, the entity lump,
+	// and the visibility header for the cluster count
+	uint64_t content_hash(RawBSP const & raw) {
+		uint64_t hash = Hash::hash64(&raw.header(), sizeof(RawBSP::Header));
+		auto ents = raw.lump(RBSP::ENTITIES);
+		hash = Hash::hash64(ents.data(), ents.size(), hash);
+		auto vis = raw.lump(RBSP::VISIBILITY);
+		return Hash::hash64(vis.data(), std::min(vis.size(), sizeof(RBSP::VisibilityHeader)), hash);
+	}
+	
+	QString hex(uint64_t v) {
+		return QString::number(v, 16).rightJustified(16, '0');
+	}
+	
+	QString path_alias(QDir const & dir, MappedFile const & file) {
+		QByteArray key = file.key().toUtf8();
+		return dir.filePath(hex(Hash::hash64(key.data(), key.size())) + ".key");
+	}
+	
+	QString snapshot_path(QDir const & dir, uint64_t hash) {
+		return dir.filePath(hex(hash) + ".snap");
+	}
+	
+	// sequential reader over a mapped snapshot, every read is bounds checked
+	struct Cursor {
+		uint8_t const * cur;
+		uint8_t const * end;
+		
+		bool read(void * dst, size_t len) {
+			if (static_cast<size_t>(end - cur) < len) return false;
+			std::memcpy(dst, cur, len);
+			cur += len;
+			return true;
+		}
+		bool read_string(char const * & str, uint32_t & len) {
+			if (!read(&len, sizeof(len)) || static_cast<size_t>(end - cur) < len) return false;
+			str = reinterpret_cast<char const *>(cur);
+			cur += len;
+			return true;
+		}
+	};
+	
+	void append(QByteArray & out, void const * data, size_t len) {
+		out.append(static_cast<char const *>(data), len);
+	}
+	
+	void append_string(QByteArray & out, char const * str, uint32_t len) {
+		append(out, &len, sizeof(len));
+		out.append(str, len);
+	}
+}
+
+qint64 DiskCache::capacity() {
+	bool ok = false;
+	qint64 mb = qEnvironmentVariable("BSPIUM_DISK_CACHE_MAX_MB").toLongLong(&ok);
+	return (ok && mb >= 0 ? mb : default_capacity_mb) * 1024 * 1024;
+}
+
+QString DiskCache::directory() {
+	if (qEnvironmentVariableIsSet("BSPIUM_DISK_CACHE_DIR"))
+		return qEnvironmentVariable("BSPIUM_DISK_CACHE_DIR");
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/parsed";
+}
+
+namespace {
+	
+	// removes the least recently used snapshots until they fit in capacity bytes, never the one named keep,
+	// then any path alias left pointing at a removed snapshot
+	void trim(QDir const & dir, qint64 capacity, QString const & keep) {
+		Trace::Scope trace { "disk cache trim" };
+		qint64 used = 0;
+		for (QFileInfo const & info : dir.entryInfoList({ "*.snap" }, QDir::Files, QDir::Time)) { // newest first
+			used += info.size();
+			if (used > capacity && info.fileName() != keep) {
+				QFile::remove(info.absoluteFilePath());
+				used -= info.size();
+			}
+		}
+		for (QFileInfo const & info : dir.entryInfoList({ "*.key" }, QDir::Files)) {
+			QFile alias { info.absoluteFilePath() };
+			if (!alias.open(QIODevice::ReadOnly)) continue;
+			QString target = dir.filePath(QString::fromLatin1(alias.readAll()) + ".snap");
+			alias.close();
+			if (!QFileInfo::exists(target)) alias.remove();
+		}
+	}
+	
+	// the entity store refers into the mapped snapshot rather than copying out of it, and keeps it mapped
+	std::optional<DiskCache::Snapshot> load_snapshot(QString const & path, uint64_t hash) {
+		QString error;
+		auto snap = MappedFile::open(path, error);
+		if (!snap || snap->size() > UINT32_MAX) return std::nullopt; // spans are 32 bit offsets
+		char const * base = reinterpret_cast<char const *>(snap->data());
+		
+		Cursor cur { snap->data(), snap->data() + snap->size() };
+		DiskCache::Snapshot snapshot;
+		Header head;
+		bool ok = cur.read(&head, sizeof(head))
+			&& !std::memcmp(head.magic, magic, sizeof(magic))
+			&& head.version == format_version
+			&& head.content_hash == hash;
+		
+		if (ok) {
+			std::copy(std::begin(head.counts), std::end(head.counts), snapshot.stats.counts.begin());
+			snapshot.stats.has_visibility = head.has_visibility;
+			snapshot.classes.reserve(head.class_count);
+			for (uint32_t i = 0; ok && i < head.class_count; i++) {
+				char const * name;
+				uint32_t len;
+				uint64_t count;
+				ok = cur.read_string(name, len) && cur.read(&count, sizeof(count));
+				if (ok) snapshot.classes.push_back({ QString::fromUtf8(name, len), count });
+			}
+			EntityStore::Builder entities { snap, base, snap->size() };
+			for (size_t e = 0; ok && e < head.entity_count; e++) {
+				uint32_t fields;
+				ok = cur.read(&fields, sizeof(fields));
+				entities.begin_entity();
+				for (uint32_t f = 0; ok && f < fields; f++) {
+					char const * key, * value;
+					uint32_t key_len, value_len;
+					ok = cur.read_string(key, key_len) && cur.read_string(value, value_len);
+					if (ok) entities.add_field({ key, key_len }, { value, value_len });
+				}
+			}
+			if (ok) snapshot.entities = entities.finish();
+		}
+		if (!ok) return std::nullopt;
+		
+		// hits count as use, so trimming drops the least recently used snapshots
+		QFile touch { path };
+		if (touch.open(QIODevice::ReadOnly)) touch.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+		return snapshot;
+	}
+}
+
+std::optional<DiskCache::Snapshot> DiskCache::load(MappedFile const & file, RawBSP const & raw) {
+	Trace::Scope trace { "disk cache load" };
+	QString dir_path = directory();
+	if (dir_path.isEmpty()) return std::nullopt;
+	QDir dir { dir_path };
+	
+	// a path alias skips hashing the entity lump entirely
+	QFile alias { path_alias(dir, file) };
+	if (alias.open(QIODevice::ReadOnly)) {
+		bool ok = false;
+		uint64_t hash = alias.readAll().toULongLong(&ok, 16);
+		if (ok) {
+			if (auto snapshot = load_snapshot(snapshot_path(dir, hash), hash)) return snapshot;
+		}
+	}
+	
+	uint64_t hash = content_hash(raw);
+	return load_snapshot(snapshot_path(dir, hash), hash);
+}
+
+bool DiskCache::store(MappedFile const & file, RawBSP const & raw, LumpStats const & stats, ClassHistogramModel::Histogram const & classes, EntityStore const & entities) {
+	Trace::Scope trace { "disk cache store" };
+	QString dir_path = directory();
+	if (dir_path.isEmpty()) return false;
+	QDir dir { dir_path };
+	if (!dir.mkpath(".")) return false;
+	
+	Header head {};
+	std::memcpy(head.magic, magic, sizeof(magic));
+	head.version = format_version;
+	head.has_visibility = stats.has_visibility;
+	head.content_hash = content_hash(raw);
+	std::copy(stats.counts.begin(), stats.counts.end(), std::begin(head.counts));
+	head.class_count = classes.size();
+	head.entity_count = entities.entity_count();
+	
+	QByteArray out;
+	append(out, &head, sizeof(head));
+	for (auto const & entry : classes) {
+		QByteArray name = entry.classname.toUtf8();
+		uint64_t count = entry.count;
+		append_string(out, name.data(), name.size());
+		append(out, &count, sizeof(count));
+	}
+	for (size_t e = 0; e < entities.entity_count(); e++) {
+		uint32_t fields = entities.field_count(e);
+		append(out, &fields, sizeof(fields));
+		for (auto const & field : entities.fields(e)) {
+			std::string_view key = entities.str(field.key), value = entities.str(field.value);
+			append_string(out, key.data(), key.size());
+			append_string(out, value.data(), value.size());
+		}
+	}
+	
+	// snapshots are written atomically, a reader never sees a partial file
+	QSaveFile snap { snapshot_path(dir, head.content_hash) };
+	if (!snap.open(QIODevice::WriteOnly) || snap.write(out) != out.size() || !snap.commit()) return false;
+	
+	QSaveFile alias { path_alias(dir, file) };
+	QByteArray alias_data = hex(head.content_hash).toLatin1();
+	bool stored = alias.open(QIODevice::WriteOnly) && alias.write(alias_data) == alias_data.size() && alias.commit();
+	trim(dir, capacity(), QFileInfo { snapshot_path(dir, head.content_hash) }.fileName());
+	return stored;
+}
+
+void DiskCache::clear() {
+	QString dir_path = directory();
+	if (dir_path.isEmpty()) return;
+	QDir dir { dir_path };
+	trim(dir, 0, {});
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ClassHistogram.hh"
+#include "EntityStore.hh"
+#include "LumpStats.hh"
+
+#include <libbsp.hh>
+
+#include <optional>
+
+class MappedFile;
+struct RawBSP;
+
+// persistent snapshots of parsed entities, classname histogram and lump counts
+// looked up by path + size + mtime, falling back to a hash of the lump directory and entity lump
+// so that copied or touched but unchanged maps still hit
+// a loaded snapshot is mapped, not copied: its entities refer into the snapshot file
+// the directory is bounded, storing trims the least recently used snapshots beyond capacity()
+namespace DiskCache {
+	
+	constexpr qint64 default_capacity_mb = 1024;
+	
+	struct Snapshot {
+		LumpStats stats;
+		ClassHistogramModel::Histogram classes;
+		std::shared_ptr<EntityStore> entities;
+	};
+	
+	// BSPIUM_DISK_CACHE_DIR overrides the default per-user cache location, an empty value disables the cache
+	QString directory();
+	// bytes of snapshots kept, BSPIUM_DISK_CACHE_MAX_MB overrides the default
+	qint64 capacity();
+	
+	// safe to call from any thread
+	std::optional<Snapshot> load(MappedFile const & file, RawBSP const & raw);
+	bool store(MappedFile const & file, RawBSP const & raw, LumpStats const & stats, ClassHistogramModel::Histogram const & classes, EntityStore const & entities);
+	// removes every snapshot, stores already loaded keep theirs mapped
+	void clear();
+}
@@ -0,0 +1,100 @@
+#include "EntityFilter.hh"
+#include "EntityTree.hh"
+#include "Trace.hh"
+
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+EntityFilterProxy::EntityFilterProxy(QObject * parent) : QSortFilterProxyModel { parent } {
+	setRecursiveFilteringEnabled(false);
+	m_debounce.setSingleShot(true);
+	m_debounce.setInterval(default_debounce_ms);
+	connect(&m_debounce, &QTimer::timeout, this, &EntityFilterProxy::start_job);
+}
+
+EntityFilterProxy::~EntityFilterProxy() {
+	cancel_job();
+}
+
+void EntityFilterProxy::setSourceModel(QAbstractItemModel * model) {
+	if (sourceModel()) disconnect(sourceModel(), nullptr, this, nullptr);
+	cancel_job();
+	m_accepted.clear();
+	m_model = qobject_cast<EntityTreeModel *>(model);
+	QSortFilterProxyModel::setSourceModel(model);
+	if (!model) return;
+	
+	// edits can change which entities match, refilter once they settle
+	auto refilter = [this](){
+		if (!m_pending_needle.empty()) m_debounce.start();
+	};
+	connect(model, &QAbstractItemModel::dataChanged, this, refilter);
+	connect(model, &QAbstractItemModel::layoutChanged, this, refilter);
+	if (!m_pending_needle.empty()) m_debounce.start();
+}
+
+void EntityFilterProxy::set_filter_text(QString const & str) {
+	std::string needle = str.toStdString();
+	EntityTreeModel::fold_case(needle);
+	if (needle == m_pending_needle) return;
+	m_pending_needle = std::move(needle);
+	cancel_job();
+	
+	if (m_pending_needle.empty()) {
+		m_debounce.stop();
+		if (m_accepted.empty()) return;
+		m_accepted.clear();
+		invalidateFilter();
+		emit filter_applied();
+		return;
+	}
+	m_debounce.start();
+}
+
+void EntityFilterProxy::cancel_job() {
+	m_generation++;
+	if (m_cancel) *m_cancel = true;
+	m_cancel.reset();
+}
+
+void EntityFilterProxy::start_job() {
+	if (!m_model) return;
+	cancel_job();
+	
+	uint64_t generation = m_generation;
+	auto cancel = m_cancel = std::make_shared<std::atomic_bool>(false);
+	auto snapshot = m_model->search_snapshot();
+	std::string needle = m_pending_needle;
+	
+	auto watcher = new QFutureWatcher<std::vector<uint8_t>> { this };
+	connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation](){
+		watcher->deleteLater();
+		if (generation != m_generation) return; // superseded
+		m_cancel.reset();
+		m_accepted = watcher->result();
+		invalidateFilter();
+		emit filter_applied();
+	});
+	
+	watcher->setFuture(QtConcurrent::run([snapshot, needle, cancel]() -> std::vector<uint8_t> {
+		Trace::Scope trace { "entity filter" };
+		constexpr size_t cancel_check_interval = 4096;
+		std::vector<uint8_t> accepted (snapshot->size());
+		for (size_t i = 0; i < snapshot->size(); i++) {
+			if (!(i % cancel_check_interval) && *cancel) return {};
+			accepted[i] = (*snapshot)[i].find(needle) != std::string::npos;
+		}
+		return accepted;
+	}));
+}
+
+bool EntityFilterProxy::filterAcceptsRow(int source_row, QModelIndex const & source_parent) const {
+	if (source_parent.isValid() || m_accepted.empty()) return true;
+	if (source_row >= (int)m_accepted.size()) return true;
+	return m_accepted[source_row];
+}
+
+bool EntityFilterProxy::lessThan(QModelIndex const & source_left, QModelIndex const & source_right) const {
+	if (!m_model) return QSortFilterProxyModel::lessThan(source_left, source_right);
+	return m_model->sort_less(source_left, source_right);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QSortFilterProxyModel>
+#include <QTimer>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+class EntityTreeModel;
+
+// filters top level entities against EntityTreeModel's precomputed search text,
+// fields are shown whenever their entity is
+// matching runs debounced on a worker thread over a snapshot of the search index,
+// the resulting row set is applied to the view in a single invalidation
+// sorting compares EntityTreeModel's precomputed keys rather than display data
+class EntityFilterProxy : public QSortFilterProxyModel {
+	Q_OBJECT
+	
+public:
+	EntityFilterProxy(QObject * parent = nullptr);
+	~EntityFilterProxy();
+	
+	void setSourceModel(QAbstractItemModel * model) override;
+	
+	static constexpr int default_debounce_ms = 150;
+	void set_debounce_interval(int ms) { m_debounce.setInterval(ms); }
+	
+public slots:
+	void set_filter_text(QString const & str);
+	
+signals:
+	// a finished filter job has been applied to the view
+	void filter_applied();
+	
+protected:
+	bool filterAcceptsRow(int source_row, QModelIndex const & source_parent) const override;
+	bool lessThan(QModelIndex const & source_left, QModelIndex const & source_right) const override;
+	
+private:
+	EntityTreeModel * m_model = nullptr;
+	QTimer m_debounce;
+	std::string m_pending_needle;
+	
+	// accepted[row] for top level rows, empty when no filter is applied
+	std::vector<uint8_t> m_accepted;
+	uint64_t m_generation = 0;
+	std::shared_ptr<std::atomic_bool> m_cancel;
+	
+	void cancel_job();
+	void start_job();
+};
@@ -0,0 +1,136 @@
+#include "EntityLinks.hh"
+#include "Trace.hh"
+
+#include <algorithm>
+
+namespace {
+	std::vector<uint32_t> const no_entities;
+	
+	void erase_entity(std::unordered_map<std::string, std::vector<uint32_t>> & map, std::string const & name, uint32_t entity) {
+		auto iter = map.find(name);
+		if (iter == map.end()) return;
+		auto & ents = iter->second;
+		ents.erase(std::remove(ents.begin(), ents.end(), entity), ents.end());
+		if (ents.empty()) map.erase(iter);
+	}
+	
+	// entity lists stay sorted, so lookups list entities in map order
+	void insert_entity(std::vector<uint32_t> & ents, uint32_t entity) {
+		ents.insert(std::upper_bound(ents.begin(), ents.end(), entity), entity);
+	}
+}
+
+EntityLinks::EntityLinks(EntityStore const & store) {
+	Trace::Scope trace { "reference graph" };
+	m_entities.resize(store.entity_count());
+	for (size_t e = 0; e < store.entity_count(); e++)
+		update(store, e);
+}
+
+std::string EntityLinks::fold(std::string_view str) {
+	std::string folded { str };
+	for (char & c : folded)
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+	return folded;
+}
+
+void EntityLinks::update(EntityStore const & store, size_t entity) {
+	remove(entity);
+	EntityLinkData & data = m_entities[entity];
+	data = {};
+	for (auto const & field : store.fields(entity)) {
+		std::string_view key = store.str(field.key), value = store.str(field.value);
+		if (value.empty()) continue;
+		if (EntityStore::iequals(key, "targetname")) {
+			data.name = fold(value);
+			continue;
+		}
+		for (size_t k = 0; k < reference_keys.size(); k++) {
+			if (!EntityStore::iequals(key, reference_keys[k])) continue;
+			data.targets.push_back({ (uint8_t)k, fold(value) });
+			break;
+		}
+	}
+	std::sort(data.targets.begin(), data.targets.end(), [](Outgoing const & a, Outgoing const & b){ return a.key < b.key; });
+	add(entity);
+}
+
+void EntityLinks::add(uint32_t entity) {
+	EntityLinkData const & data = m_entities[entity];
+	if (!data.name.empty()) insert_entity(m_named[data.name], entity);
+	for (size_t i = 0; i < data.targets.size(); i++) {
+		std::string const & name = data.targets[i].name;
+		// an entity is listed once per distinct name it references
+		bool seen = std::any_of(data.targets.begin(), data.targets.begin() + i, [&](Outgoing const & o){ return o.name == name; });
+		if (!seen) insert_entity(m_referrers[name], entity);
+	}
+}
+
+void EntityLinks::remove(uint32_t entity) {
+	EntityLinkData const & data = m_entities[entity];
+	if (!data.name.empty()) erase_entity(m_named, data.name, entity);
+	for (auto const & out : data.targets)
+		erase_entity(m_referrers, out.name, entity);
+}
+
+std::vector<uint32_t> const & EntityLinks::named(std::string_view name) const {
+	auto iter = m_named.find(fold(name));
+	return iter == m_named.end() ? no_entities : iter->second;
+}
+
+std::vector<EntityLinks::Reference> EntityLinks::targets_of(size_t entity) const {
+	std::vector<Reference> refs;
+	for (auto const & out : m_entities[entity].targets) {
+		auto iter = m_named.find(out.name);
+		if (iter == m_named.end()) {
+			refs.push_back({ no_entity, reference_keys[out.key], out.name });
+			continue;
+		}
+		for (uint32_t target : iter->second)
+			refs.push_back({ target, reference_keys[out.key], out.name });
+	}
+	return refs;
+}
+
+std::vector<EntityLinks::Reference> EntityLinks::targeted_by(size_t entity) const {
+	std::vector<Reference> refs;
+	std::string const & name = m_entities[entity].name;
+	if (name.empty()) return refs;
+	auto iter = m_referrers.find(name);
+	if (iter == m_referrers.end()) return refs;
+	for (uint32_t referrer : iter->second) {
+		for (auto const & out : m_entities[referrer].targets)
+			if (out.name == name) refs.push_back({ referrer, reference_keys[out.key], out.name });
+	}
+	return refs;
+}
+
+EntityLinks::Report EntityLinks::report() const {
+	Trace::Scope trace { "reference report" };
+	// walks entities rather than the hash tables so the report comes out in map order
+	Report rep;
+	for (uint32_t e = 0; e < m_entities.size(); e++) {
+		EntityLinkData const & data = m_entities[e];
+		for (auto const & out : data.targets)
+			if (!m_named.count(out.name)) rep.dangling.push_back({ e, reference_keys[out.key], out.name });
+		if (data.name.empty()) continue;
+		auto const & holders = m_named.at(data.name);
+		if (holders.size() > 1 && holders.front() == e) rep.duplicates.emplace_back(data.name, holders);
+	}
+	return rep;
+}
+
+size_t EntityLinks::memory_estimate() const {
+	constexpr size_t node_overhead = 64; // hash node and allocator bookkeeping
+	size_t bytes = sizeof(*this) + m_entities.capacity() * sizeof(EntityLinkData);
+	for (auto const & data : m_entities) {
+		bytes += data.name.capacity() + data.targets.capacity() * sizeof(Outgoing);
+		for (auto const & out : data.targets) bytes += out.name.capacity();
+	}
+	for (auto const * map : { &m_named, &m_referrers }) {
+		bytes += map->bucket_count() * sizeof(void *);
+		for (auto const & [name, ents] : *map)
+			bytes += node_overhead + name.capacity() + ents.capacity() * sizeof(uint32_t);
+	}
+	return bytes;
+}
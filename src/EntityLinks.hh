@@ -0,0 +1,67 @@
+#pragma once
+
+#include "EntityStore.hh"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// targetname references between entities, names compare case-insensitively like the game does
+// built in one pass and kept current per entity, lookups in either direction are a single hash probe
+class EntityLinks {
+public:
+	// keys whose value names another entity's targetname
+	static constexpr std::array<std::string_view, 11> reference_keys {
+		"target", "target2", "target3", "target4", "target5", "target6",
+		"killtarget", "NPC_target", "opentarget", "closetarget", "paintarget",
+	};
+	
+	static constexpr uint32_t no_entity = UINT32_MAX;
+	struct Reference {
+		uint32_t entity; // no_entity for a reference nothing answers to
+		std::string_view key; // one of reference_keys
+		std::string name;
+	};
+	struct Report {
+		std::vector<Reference> dangling; // references to names no entity has
+		std::vector<std::pair<std::string, std::vector<uint32_t>>> duplicates; // names held by more than one entity
+	};
+	
+	EntityLinks() = default;
+	explicit EntityLinks(EntityStore const & store);
+	
+	// re-reads one entity's name and references after an edit
+	void update(EntityStore const & store, size_t entity);
+	
+	// entities named by any of entity's references, in reference key order, dangling references included
+	std::vector<Reference> targets_of(size_t entity) const;
+	// entities holding a given targetname
+	std::vector<uint32_t> const & named(std::string_view name) const;
+	// references made to entity's targetname by other entities
+	std::vector<Reference> targeted_by(size_t entity) const;
+	
+	// linear in the number of names and references
+	Report report() const;
+	size_t memory_estimate() const;
+	
+private:
+	struct Outgoing {
+		uint8_t key; // index into reference_keys
+		std::string name; // folded
+	};
+	struct EntityLinkData {
+		std::string name; // folded targetname, empty if none
+		std::vector<Outgoing> targets;
+	};
+	
+	std::vector<EntityLinkData> m_entities;
+	std::unordered_map<std::string, std::vector<uint32_t>> m_named;
+	std::unordered_map<std::string, std::vector<uint32_t>> m_referrers; // an entity appears once per reference it makes
+	
+	static std::string fold(std::string_view str);
+	void add(uint32_t entity);
+	void remove(uint32_t entity);
+};
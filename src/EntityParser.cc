@@ -0,0 +1,154 @@
+#include "EntityParser.hh"
+#include "MappedFile.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+	
+	bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+	
+	constexpr size_t block_size = 16;
+	
+	// bit i set where block[i] == c
+	uint32_t match(char const * block, char c) {
+#ifdef __SSE2__
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(block));
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+#else
+		uint32_t mask = 0;
+		for (size_t i = 0; i < block_size; i++) mask |= uint32_t { block[i] == c } << i;
+		return mask;
+#endif
+	}
+	
+	// calls fn with every block of [begin, end), the last one zero padded
+	// never reads past end, the lump may end at the end of the mapping
+	template <typename F> void for_blocks(char const * begin, char const * end, F const & fn) {
+		char const * block = begin;
+		for (; end - block >= static_cast<ptrdiff_t>(block_size); block += block_size) fn(block);
+		if (block != end) {
+			char tail[block_size] {};
+			std::memcpy(tail, block, end - block);
+			fn(tail);
+		}
+	}
+	
+	// positions of every '"' in order, found 16 bytes at a time
+	// keys and values are short, so this beats a memchr call per string by a wide margin
+	class QuoteScanner {
+	public:
+		QuoteScanner(char const * begin, char const * end) : m_block { begin }, m_end { end } { load(); }
+		
+		// end once there are no more
+		char const * next() {
+			while (!m_mask) {
+				m_block += block_size;
+				if (m_block >= m_end) return m_end;
+				load();
+			}
+			char const * pos = m_block + std::countr_zero(m_mask);
+			m_mask &= m_mask - 1;
+			return pos;
+		}
+		
+	private:
+		char const * m_block;
+		char const * m_end;
+		uint32_t m_mask = 0;
+		
+		void load() {
+			for_blocks(m_block, std::min(m_block + block_size, m_end), [this](char const * block){
+				m_mask = match(block, '"');
+			});
+		}
+	};
+}
+
+std::shared_ptr<EntityStore> EntityParser::parse(std::string_view lump, std::shared_ptr<void const> backing, size_t backing_bytes, std::string & error) {
+	Trace::Scope trace { "parse entity lump" };
+	
+	// the lump is normally NUL terminated
+	if (auto nul = static_cast<char const *>(std::memchr(lump.data(), '\0', lump.size())))
+		lump = lump.substr(0, nul - lump.data());
+	char const * p = lump.data();
+	char const * const end = p + lump.size();
+	
+	// sized up front, each field is four quotes
+	size_t braces = 0, quotes_count = 0;
+	for_blocks(p, end, [&](char const * block){
+		braces += std::popcount(match(block, '{'));
+		quotes_count += std::popcount(match(block, '"'));
+	});
+	EntityStore::Builder builder { std::move(backing), lump.data(), backing_bytes };
+	builder.reserve(braces, quotes_count / 4);
+	QuoteScanner quotes { p, end };
+	bool in_entity = false;
+	bool have_key = false;
+	std::string_view key;
+	std::vector<std::string_view> keys; // of the current entity
+	
+	auto fail = [&](char const * what) {
+		error = std::string { what } + " at offset " + std::to_string(p - lump.data());
+		return nullptr;
+	};
+	// between strings there may only be whitespace and braces
+	auto structure = [&](char const * until) {
+		for (; p != until; p++) {
+			if (is_space(*p)) continue;
+			if (*p == '{' && !in_entity) {
+				in_entity = true;
+				builder.begin_entity();
+				keys.clear();
+			} else if (*p == '}' && in_entity && !have_key) {
+				in_entity = false;
+			} else {
+				return false;
+			}
+		}
+		return true;
+	};
+	
+	for (;;) {
+		char const * open = quotes.next();
+		if (!structure(open)) return fail("unexpected character");
+		if (open == end) break;
+		if (!in_entity) return fail("string outside of an entity");
+		char const * close = quotes.next();
+		if (close == end) return fail("unterminated string");
+		std::string_view str { open + 1, static_cast<size_t>(close - open - 1) };
+		p = close + 1;
+		
+		if (!have_key) {
+			key = str;
+			have_key = true;
+			continue;
+		}
+		have_key = false;
+		if (std::any_of(keys.begin(), keys.end(), [&](std::string_view k){ return EntityStore::iequals(k, key); })) continue;
+		keys.push_back(key);
+		builder.add_field(key, str);
+	}
+	if (in_entity) return fail("unterminated entity");
+	return builder.finish();
+}
+
+std::shared_ptr<EntityStore> EntityParser::parse_map(std::shared_ptr<MappedFile> const & file, RawBSP const & raw, BSP::Reader & bspr, std::string & warning) {
+	auto lump = raw.lump(RBSP::ENTITIES);
+	std::string error;
+	if (auto ents = parse({ reinterpret_cast<char const *>(lump.data()), lump.size() }, file, file->size(), error)) return ents;
+	warning = "entity lump parsed by libbsp, the in place parser rejected it: " + error;
+	bspr.rebase(file->data());
+	return EntityStore::from_entities(bspr.entities_parsed());
+}
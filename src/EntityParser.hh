@@ -0,0 +1,24 @@
+#pragma once
+
+#include "EntityStore.hh"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+class MappedFile;
+struct RawBSP;
+
+// entity lump parser that builds an EntityStore in place over the lump, keys and values refer into it
+// rather than being copied, only edits allocate strings
+namespace EntityParser {
+	
+	// backing keeps the lump's memory alive for as long as the store or a clone of it lives,
+	// backing_bytes is charged to the store's memory estimate for doing so
+	// null with error on malformed input, duplicate keys within an entity keep their first value
+	std::shared_ptr<EntityStore> parse(std::string_view lump, std::shared_ptr<void const> backing, size_t backing_bytes, std::string & error);
+	
+	// the entity lump of a mapped map, parsed in place and pinning the whole mapping, or by libbsp's more lenient parser for lumps parse() rejects,
+	// warning then says why, bspr is rebased onto file only for the fallback
+	std::shared_ptr<EntityStore> parse_map(std::shared_ptr<MappedFile> const & file, RawBSP const & raw, BSP::Reader & bspr, std::string & warning);
+}
@@ -0,0 +1,170 @@
+#include "EntityStore.hh"
+
+#include <algorithm>
+#include <cstring>
+
+StringPool::StringPool(StringPool const & other) {
+	*this = other;
+}
+
+StringPool & StringPool::operator = (StringPool const & other) {
+	if (this == &other) return *this;
+	*this = StringPool {};
+	m_strings.reserve(other.size());
+	for (Id id = 0; id < other.size(); id++) store(other.get(id)); // ids are assigned in order, so they carry over
+	return *this;
+}
+
+StringPool::Id StringPool::intern(std::string_view str) {
+	auto iter = m_index.find(str);
+	if (iter != m_index.end()) return iter->second;
+	return store(str);
+}
+
+StringPool::Id StringPool::reference(std::string_view str) {
+	m_spans.push_back({ static_cast<uint32_t>(str.data() - m_base), static_cast<uint32_t>(str.size()) });
+	return m_spans.size() - 1;
+}
+
+void StringPool::reserve(size_t count) {
+	if (m_base) m_spans.reserve(count);
+	else m_strings.reserve(count);
+}
+
+StringPool::Id StringPool::store(std::string_view str) {
+	// the empty string needs no storage, and a fresh pool has no current block to point into
+	std::string_view stored { "", 0 };
+	if (!str.empty()) {
+		char * dst;
+		if (str.size() > block_size / 4) {
+			// large strings get a block of their own rather than wasting the tail of the current one,
+			// it goes in front of the current block so that one stays last
+			auto pos = m_blocks.empty() ? m_blocks.end() : m_blocks.end() - 1;
+			dst = m_blocks.emplace(pos, new char[str.size()])->get();
+		} else {
+			if (m_block_used + str.size() > block_size) {
+				m_blocks.emplace_back(new char[block_size]);
+				m_block_used = 0;
+			}
+			dst = m_blocks.back().get() + m_block_used;
+			m_block_used += str.size();
+		}
+		std::memcpy(dst, str.data(), str.size());
+		m_owned_bytes += str.size();
+		stored = { dst, str.size() };
+	}
+	
+	Id id = m_strings.size();
+	m_strings.push_back(stored);
+	m_index.emplace(stored, id); // keeps the first id for strings a copied reference pool held more than once
+	return id;
+}
+
+size_t StringPool::memory_estimate() const {
+	size_t bytes = sizeof(*this) + m_owned_bytes + m_backing_bytes;
+	bytes += m_strings.capacity() * sizeof(std::string_view) + m_spans.capacity() * sizeof(Span);
+	bytes += m_index.size() * (sizeof(std::pair<std::string_view, Id>) + 2 * sizeof(void *)) + m_index.bucket_count() * sizeof(void *);
+	return bytes;
+}
+
+void EntityStore::Builder::reserve(size_t entities, size_t fields) {
+	m_offsets.reserve(entities + 1);
+	m_fields.reserve(fields);
+	if (m_referenced) m_pool->reserve(fields * 2);
+}
+
+void EntityStore::Builder::begin_entity() {
+	m_offsets.push_back(m_fields.size());
+}
+
+void EntityStore::Builder::add_field(std::string_view key, std::string_view value) {
+	if (m_referenced) m_fields.push_back({ m_pool->reference(key), m_pool->reference(value) });
+	else m_fields.push_back({ m_pool->intern(key), m_pool->intern(value) });
+}
+
+std::shared_ptr<EntityStore> EntityStore::Builder::finish() {
+	auto store = std::make_shared<EntityStore>();
+	m_offsets.push_back(m_fields.size());
+	store->m_pool = std::move(m_pool);
+	store->m_offsets = std::move(m_offsets);
+	store->m_fields = std::move(m_fields);
+	store->m_offsets.shrink_to_fit();
+	store->m_fields.shrink_to_fit();
+	*this = Builder {};
+	return store;
+}
+
+std::shared_ptr<EntityStore> EntityStore::from_entities(BSP::Reader::EntityArray const & ents) {
+	Builder builder;
+	for (auto const & ent : ents) {
+		builder.begin_entity();
+		for (auto const & kvp : ent)
+			builder.add_field({ kvp.first.data(), kvp.first.size() }, { kvp.second.data(), kvp.second.size() });
+	}
+	return builder.finish();
+}
+
+BSP::Reader::EntityArray EntityStore::to_entities() const {
+	BSP::Reader::EntityArray ents (entity_count());
+	for (size_t e = 0; e < entity_count(); e++) {
+		for (auto const & field : fields(e)) {
+			std::string_view k = str(field.key), v = str(field.value);
+			ents[e].emplace(meadow::istring { k.data(), k.size() }, meadow::istring { v.data(), v.size() });
+		}
+	}
+	return ents;
+}
+
+bool EntityStore::iequals(std::string_view a, std::string_view b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		char ca = a[i], cb = b[i];
+		if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+		if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+		if (ca != cb) return false;
+	}
+	return true;
+}
+
+int EntityStore::icompare(std::string_view a, std::string_view b) {
+	size_t len = std::min(a.size(), b.size());
+	for (size_t i = 0; i < len; i++) {
+		unsigned char ca = a[i], cb = b[i];
+		if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+		if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+		if (ca != cb) return ca < cb ? -1 : 1;
+	}
+	return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+std::optional<size_t> EntityStore::find(size_t entity, std::string_view key) const {
+	auto f = fields(entity);
+	for (size_t i = 0; i < f.size(); i++)
+		if (iequals(str(f[i].key), key)) return i;
+	return std::nullopt;
+}
+
+std::optional<std::string_view> EntityStore::value_of(size_t entity, std::string_view key) const {
+	auto idx = find(entity, key);
+	if (!idx) return std::nullopt;
+	return value(entity, *idx);
+}
+
+EntityStore::Id EntityStore::intern(std::string_view str) {
+	return m_local.intern(str) | local_bit;
+}
+
+void EntityStore::set_key(size_t entity, size_t field, std::string_view key) {
+	m_fields[m_offsets[entity] + field].key = intern(key);
+}
+
+void EntityStore::set_value(size_t entity, size_t field, std::string_view value) {
+	m_fields[m_offsets[entity] + field].value = intern(value);
+}
+
+size_t EntityStore::memory_estimate(bool include_shared_pool) const {
+	size_t bytes = sizeof(*this) + m_local.memory_estimate();
+	bytes += m_offsets.capacity() * sizeof(uint32_t) + m_fields.capacity() * sizeof(Field);
+	if (include_shared_pool && m_pool) bytes += m_pool->memory_estimate();
+	return bytes;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <libbsp.hh>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// deduplicated string storage, every distinct byte string is stored once
+// ids are dense and strings never move once interned
+// a pool may instead refer to strings within memory it keeps alive, those are neither copied nor deduplicated,
+// and take 8 bytes each as an offset from base, the pinned memory counts towards the pool's estimate
+class StringPool {
+public:
+	using Id = uint32_t;
+	
+	StringPool() = default;
+	StringPool(std::shared_ptr<void const> backing, char const * base, size_t backing_bytes)
+		: m_base { base }, m_backing { std::move(backing) }, m_backing_bytes { backing_bytes } {}
+	// a copy owns all of its strings, with the same ids
+	StringPool(StringPool const & other);
+	StringPool & operator = (StringPool const & other);
+	StringPool(StringPool &&) = default;
+	StringPool & operator = (StringPool &&) = default;
+	
+	// a pool made over backing memory only takes references
+	Id intern(std::string_view str);
+	// str must lie within the backing memory, less than 4GB past base
+	Id reference(std::string_view str);
+	void reserve(size_t count);
+	std::string_view get(Id id) const { return m_base ? std::string_view { m_base + m_spans[id].offset, m_spans[id].length } : m_strings[id]; }
+	size_t size() const { return m_base ? m_spans.size() : m_strings.size(); }
+	size_t memory_estimate() const;
+	
+private:
+	static constexpr size_t block_size = 64 * 1024;
+	std::vector<std::unique_ptr<char[]>> m_blocks;
+	size_t m_block_used = block_size;
+	size_t m_owned_bytes = 0;
+	std::vector<std::string_view> m_strings;
+	std::unordered_map<std::string_view, Id> m_index;
+	
+	struct Span {
+		uint32_t offset;
+		uint32_t length;
+	};
+	char const * m_base = nullptr;
+	std::vector<Span> m_spans;
+	std::shared_ptr<void const> m_backing;
+	size_t m_backing_bytes = 0;
+	
+	Id store(std::string_view str);
+};
+
+// entity key/value pairs as interned string ids in flat arrays
+// the pool built with the store is immutable and shared by clones, strings introduced by edits go to a per-store pool,
+// so a clone costs two id arrays and editing a shared store is copy-on-write
+class EntityStore {
+public:
+	using Id = StringPool::Id;
+	struct Field {
+		Id key;
+		Id value;
+	};
+	
+	class Builder {
+	public:
+		Builder() = default;
+		// keys and values added must lie within backing from base, they are referenced rather than interned
+		// backing_bytes is what keeping backing alive costs, e.g. the size of a mapped file
+		Builder(std::shared_ptr<void const> backing, char const * base, size_t backing_bytes)
+			: m_pool { std::make_shared<StringPool>(std::move(backing), base, backing_bytes) }, m_referenced { true } {}
+		
+		void reserve(size_t entities, size_t fields);
+		void begin_entity();
+		void add_field(std::string_view key, std::string_view value);
+		std::shared_ptr<EntityStore> finish();
+		
+	private:
+		std::shared_ptr<StringPool> m_pool = std::make_shared<StringPool>();
+		std::vector<uint32_t> m_offsets;
+		std::vector<Field> m_fields;
+		bool m_referenced = false;
+	};
+	
+	static std::shared_ptr<EntityStore> from_entities(BSP::Reader::EntityArray const & ents);
+	BSP::Reader::EntityArray to_entities() const;
+	
+	size_t entity_count() const { return m_offsets.size() - 1; }
+	size_t field_count(size_t entity) const { return m_offsets[entity + 1] - m_offsets[entity]; }
+	std::span<Field const> fields(size_t entity) const { return { m_fields.data() + m_offsets[entity], field_count(entity) }; }
+	
+	std::string_view str(Id id) const { return (id & local_bit) ? m_local.get(id & ~local_bit) : m_pool->get(id); }
+	std::string_view key(size_t entity, size_t field) const { return str(fields(entity)[field].key); }
+	std::string_view value(size_t entity, size_t field) const { return str(fields(entity)[field].value); }
+	
+	// field index of key in entity, keys compare case-insensitively
+	std::optional<size_t> find(size_t entity, std::string_view key) const;
+	std::optional<std::string_view> value_of(size_t entity, std::string_view key) const;
+	static bool iequals(std::string_view a, std::string_view b);
+	// <0, 0, >0 comparing ASCII case folded
+	static int icompare(std::string_view a, std::string_view b);
+	
+	std::shared_ptr<EntityStore> clone() const { return std::make_shared<EntityStore>(*this); }
+	// edits always copy, so a store referencing a mapped lump never writes to it
+	void set_key(size_t entity, size_t field, std::string_view key);
+	void set_value(size_t entity, size_t field, std::string_view value);
+	
+	// the shared pool is only counted when asked for, as it may be accounted for elsewhere
+	size_t memory_estimate(bool include_shared_pool = true) const;
+	
+private:
+	static constexpr Id local_bit = 0x80000000;
+	
+	std::shared_ptr<StringPool const> m_pool;
+	StringPool m_local;
+	std::vector<uint32_t> m_offsets { 0 };
+	std::vector<Field> m_fields;
+	
+	Id intern(std::string_view str);
+};
@@ -1,63 +1,144 @@
 #include "EntityTree.hh"
+#include "Parallel.hh"
+#include "Trace.hh"
 
 #include <QDebug>
+#include <QIODevice>
+#include <QRegularExpression>
+#include <QSet>
 #include <QSize>
 #include <QMessageBox>
 
-EntityTreeModel::EntityTreeModel(BSP::Reader::EntityArray const & ents) {
+#include <algorithm>
+#include <numeric>
+#include <optional>
+
+EntityTreeModel::EntityTreeModel(std::shared_ptr<EntityStore> store) : m_data { std::move(store) } {
 	
-	m_data = std::make_shared<BSPI::EntityArray>(ents);
+	Trace::Scope trace { "build entity model" };
+	m_links = EntityLinks { *m_data };
 	
-	m_root.reset( new EntityTreeRoot );
-	m_root->source = m_data;
-		
-	size_t entity_idx = 0;
-	for (auto entity_iter = ents.begin(); entity_iter != ents.end(); entity_iter++, entity_idx++) {
-		auto & ent_item_p = m_root->children.emplace_back( new EntityTreeEnt );
-		EntityTreeEnt * ent_item = static_cast<EntityTreeEnt *>(ent_item_p.get());
-		ent_item->parent = m_root.get();
-		ent_item->child_index = entity_idx;
-		ent_item->entity_index = entity_idx;
-		ent_item->data_parent = &m_data->at(ent_item->entity_index);
-		
-		size_t field_idx = 0;
-		for (auto field_iter = entity_iter->begin(); field_iter != entity_iter->end(); field_iter++, field_idx++) {
-			auto & field_item_p = ent_item->children.emplace_back( new EntityTreeField );
-			EntityTreeField * field_item = static_cast<EntityTreeField *>(field_item_p.get());
-			field_item->parent = ent_item;
-			field_item->child_index = field_idx;
-			field_item->data_parent = ent_item->data_parent;
-			field_item->key = field_iter->first;
-		}
+	Trace::Scope trace_search { "search index" };
+	m_search = std::make_shared<SearchIndex>(entity_count());
+	for (size_t i = 0; i < m_search->size(); i++)
+		update_search(i);
+	
+	// serialized lazily on first write
+	m_serialized.resize(entity_count());
+	m_serialized_dirty.resize(entity_count(), true);
+}
+
+size_t EntityTreeModel::memory_estimate() const {
+	size_t bytes = sizeof(*this) + m_data->memory_estimate() + m_links.memory_estimate();
+	for (auto const & str : *m_search) bytes += sizeof(str) + str.capacity();
+	for (auto const & str : m_serialized) bytes += sizeof(str) + str.capacity();
+	bytes += m_serialized_dirty.capacity();
+	for (auto const & ranks : m_sort_ranks) bytes += ranks.capacity() * sizeof(uint32_t);
+	return bytes;
+}
+
+EntityStore & EntityTreeModel::detach() {
+	if (m_data.use_count() > 1) {
+		Trace::Scope trace { "detach entity store" };
+		m_data = m_data->clone();
 	}
+	return *m_data;
+}
+
+void EntityTreeModel::fold_case(std::string & str) {
+	for (char & c : str)
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
 }
 
 BSP::LumpProviderPtr EntityTreeModel::generate_provider() {
-	return std::make_shared<BSP::BSPIEntityArrayLumpProvider>(m_data);
+	Trace::Scope trace { "generate entity provider" };
+	return std::make_shared<BSP::BSPIEntityArrayLumpProvider>(std::make_shared<BSPI::EntityArray>(m_data->to_entities()));
 }
 
-QModelIndex EntityTreeModel::index(int row, int column, QModelIndex const & parent) const {
-	if (parent.isValid() && parent.column()) return {};
-	EntityTreeItem * item = get_item(parent);
-	if (!item) return {};
+bool EntityTreeModel::write_entities(QIODevice & dev) {
+	Trace::Scope trace { "serialize entities" };
+	for (size_t i = 0; i < m_serialized.size(); i++) {
+		if (m_serialized_dirty[i]) {
+			serialize(i);
+			m_serialized_dirty[i] = false;
+		}
+		std::string const & str = m_serialized[i];
+		if (dev.write(str.data(), str.size()) != (qint64)str.size()) return false;
+	}
+	return dev.write("", 1) == 1; // lump text is null terminated
+}
+
+std::optional<size_t> EntityTreeModel::entity_of(QModelIndex const & index) const {
+	if (!index.isValid() || index.model() != this) return std::nullopt;
+	if (index.internalId() == entity_row_id) return index.row();
+	return index.internalId() - 1;
+}
+
+bool EntityTreeModel::sort_less(QModelIndex const & left, QModelIndex const & right) const {
+	// ties fall back to row order, so sorting is stable across edits
+	size_t l = left.row(), r = right.row();
+	if (left.internalId() == entity_row_id) {
+		if (left.column() != 1 && left.column() != 2) return l < r;
+		auto const & ranks = sort_ranks(left.column());
+		return ranks[l] != ranks[r] ? ranks[l] < ranks[r] : l < r;
+	}
+	size_t entity_index = left.internalId() - 1;
+	int cmp = 0;
+	switch (left.column()) {
+		case 0: cmp = EntityStore::icompare(m_data->key(entity_index, l), m_data->key(entity_index, r)); break;
+		case 1: cmp = EntityStore::icompare(m_data->value(entity_index, l), m_data->value(entity_index, r)); break;
+	}
+	return cmp ? cmp < 0 : l < r;
+}
+
+std::vector<uint32_t> const & EntityTreeModel::sort_ranks(int column) const {
+	auto & ranks = m_sort_ranks[column - 1];
+	if (ranks.size() == entity_count()) return ranks;
+	
+	Trace::Scope trace { "entity sort keys" };
+	char const * key = column == 1 ? "classname" : "targetname";
+	size_t n = entity_count();
+	std::vector<std::string> folded (n);
+	Parallel::for_chunks(n, 4096, [&](Parallel::Range r){
+		for (size_t e = r.begin; e < r.end; e++) {
+			folded[e] = m_data->value_of(e, key).value_or("");
+			fold_case(folded[e]);
+		}
+	});
+	std::vector<uint32_t> order (n);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){ return folded[a] < folded[b]; });
 	
-	if (row >= (int)item->children.size()) return {};
-	EntityTreeItem * child = item->children[row].get();
-	if (!child) return {};
-	return createIndex(row, column, child);
+	// equal keys share a rank, entities without the key rank first
+	ranks.resize(n);
+	uint32_t rank = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (i && folded[order[i]] != folded[order[i - 1]]) rank++;
+		ranks[order[i]] = rank;
+	}
+	return ranks;
+}
+
+QModelIndex EntityTreeModel::index(int row, int column, QModelIndex const & parent) const {
+	if (row < 0) return {};
+	if (!parent.isValid()) {
+		if (row >= (int)entity_count()) return {};
+		return createIndex(row, column, entity_row_id);
+	}
+	if (parent.column() || parent.internalId() != entity_row_id) return {};
+	if (row >= (int)field_count(parent.row())) return {};
+	return createIndex(row, column, static_cast<quintptr>(parent.row()) + 1);
 }
 
 QModelIndex EntityTreeModel::parent(QModelIndex const & index) const {
-	if (!index.isValid()) return {};
-	EntityTreeItem * item = reinterpret_cast<EntityTreeItem *>(index.internalPointer());
-	if (!item || !item->parent || item->parent == m_root.get()) return {};
-	return createIndex(item->child_index, 0, item->parent);
+	if (!index.isValid() || index.internalId() == entity_row_id) return {};
+	return createIndex(index.internalId() - 1, 0, entity_row_id);
 }
 
 int EntityTreeModel::rowCount(QModelIndex const & parent) const {
-	if (!parent.isValid()) return m_root->children.size();
-	EntityTreeItem * item = reinterpret_cast<EntityTreeItem *>(parent.internalPointer());
-	return item->children.size();
+	if (!parent.isValid()) return entity_count();
+	if (parent.column() || parent.internalId() != entity_row_id) return 0;
+	return field_count(parent.row());
 }
 
 int EntityTreeModel::columnCount(QModelIndex const &) const {
@@ -65,15 +146,44 @@ int EntityTreeModel::columnCount(QModelIndex const &) const {
 }
 
 QVariant EntityTreeModel::data(QModelIndex const & index, int role) const {
-	EntityTreeItem * item = reinterpret_cast<EntityTreeItem *>(index.internalPointer());
 	if (!index.isValid()) return {};
-	return item->get_data(role, index.column());
+	switch (role) {
+		default: return {};
+		case Qt::DisplayRole:
+		case Qt::EditRole:
+			break;
+	}
+	
+	if (index.internalId() == entity_row_id) {
+		switch (index.column()) {
+			default: return {};
+			case 0: return index.row();
+			case 1: return entity_value(index.row(), "classname");
+			case 2: return entity_value(index.row(), "targetname");
+		}
+	}
+	
+	size_t entity_index = index.internalId() - 1;
+	std::string_view str;
+	switch (index.column()) {
+		default: return {};
+		case 0: str = m_data->key(entity_index, index.row()); break;
+		case 1: str = m_data->value(entity_index, index.row()); break;
+	}
+	return QString::fromUtf8(str.data(), str.size());
 }
 
 Qt::ItemFlags EntityTreeModel::flags(QModelIndex const & index) const {
-	EntityTreeItem * item = get_item(index);
-	if (!item) return Qt::NoItemFlags;
-	else return item->get_flags(index.column());
+	if (!index.isValid()) return Qt::ItemIsEnabled;
+	if (index.internalId() == entity_row_id) {
+		if (!index.column()) return Qt::ItemIsEnabled;
+		else return Qt::NoItemFlags;
+	}
+	switch (index.column()) {
+		case 0:
+		case 1: return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemNeverHasChildren | Qt::ItemIsEditable;
+		default: return Qt::ItemNeverHasChildren;
+	}
 }
 
 bool EntityTreeModel::setData(QModelIndex const & index, QVariant const & value, int role) {
@@ -82,42 +192,193 @@ bool EntityTreeModel::setData(QModelIndex const & index, QVariant const & value,
 		case Qt::EditRole:
 			break;
 	}
-	EntityTreeItem * item = get_item(index);
-	if (!item) return false;
+	if (!index.isValid() || index.internalId() == entity_row_id) return false;
 	
-	if (dynamic_cast<EntityTreeRoot *>(item)) return false;
-	if (dynamic_cast<EntityTreeEnt *>(item)) return false;
-	if (dynamic_cast<EntityTreeField *>(item)) {
-		EntityTreeField * f = dynamic_cast<EntityTreeField *>(item);
-		meadow::istring new_value = meadow::s2i(value.toString().toStdString());
-		if (!new_value.size()) return false;
-		switch (index.column()) {
-			case 0: {
-				if (new_value == f->key) return false;
-				if (f->data_parent->find(new_value) != f->data_parent->end()) {
-					QMessageBox::critical(nullptr, "Cannot Rename Field", "Cannot rename field, new field value already exists.");
-					return false;
+	size_t entity_index = index.internalId() - 1;
+	size_t field_index = index.row();
+	
+	std::string new_value = value.toString().toStdString();
+	if (!new_value.size()) return false;
+	switch (index.column()) {
+		case 0: {
+			if (EntityStore::iequals(new_value, m_data->key(entity_index, field_index))) return false;
+			if (m_data->find(entity_index, new_value)) {
+				QMessageBox::critical(nullptr, "Cannot Rename Field", "Cannot rename field, new field value already exists.");
+				return false;
+			}
+			sort_key_changed(m_data->key(entity_index, field_index));
+			sort_key_changed(new_value);
+			detach().set_key(entity_index, field_index, new_value);
+			entity_changed(entity_index);
+			emit dataChanged(index, index);
+			return true;
+		}
+		case 1: {
+			detach().set_value(entity_index, field_index, new_value);
+			sort_key_changed(m_data->key(entity_index, field_index));
+			entity_changed(entity_index);
+			emit dataChanged(index, index);
+			return true;
+		}
+		default: return false;
+	}
+}
+
+EntityBulkReplaceResult EntityTreeModel::replace_all(EntityBulkReplace const & op) {
+	
+	struct Edit {
+		uint32_t entity;
+		uint32_t field;
+		std::optional<std::string> key;
+		std::optional<std::string> value;
+	};
+	struct Partial {
+		std::vector<Edit> edits;
+		QStringList errors;
+	};
+	constexpr int max_errors = 50;
+	
+	Trace::Scope trace { "bulk replace" };
+	EntityBulkReplaceResult result;
+	if (op.find.isEmpty() || (!op.keys && !op.values)) return result;
+	
+	Qt::CaseSensitivity cs = op.case_sensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+	QRegularExpression const regex { op.find, op.case_sensitive ? QRegularExpression::NoPatternOption : QRegularExpression::CaseInsensitiveOption };
+	if (op.regex && !regex.isValid()) {
+		result.errors.append("Invalid regular expression: " + regex.errorString());
+		return result;
+	}
+	
+	std::vector<std::string> only_keys;
+	for (auto const & key : op.only_keys)
+		only_keys.push_back(key.toStdString());
+	
+	// edits are computed in parallel without touching the model
+	Partial found = Parallel::reduce_chunks<Partial>(entity_count(), 256, [&](Parallel::Range r){
+		Partial part;
+		QRegularExpression re = regex;
+		auto apply = [&](std::string_view str) -> std::optional<std::string> {
+			QString qstr = QString::fromUtf8(str.data(), str.size());
+			QString replaced = qstr;
+			if (op.regex) replaced.replace(re, op.replace);
+			else replaced.replace(op.find, op.replace, cs);
+			if (replaced == qstr) return std::nullopt;
+			return replaced.toStdString();
+		};
+		auto is_only_key = [&](std::string_view key){
+			return std::any_of(only_keys.begin(), only_keys.end(), [&](std::string const & k){ return EntityStore::iequals(k, key); });
+		};
+		
+		for (size_t e = r.begin; e < r.end; e++) {
+			size_t first_edit = part.edits.size();
+			for (size_t f = 0; f < field_count(e); f++) {
+				std::string_view key = m_data->key(e, f);
+				if (!only_keys.empty() && !is_only_key(key)) continue;
+				Edit edit { (uint32_t)e, (uint32_t)f, std::nullopt, std::nullopt };
+				if (op.keys) edit.key = apply(key);
+				if (op.values) edit.value = apply(m_data->value(e, f));
+				if (edit.key || edit.value) part.edits.push_back(std::move(edit));
+			}
+			if (first_edit == part.edits.size()) continue;
+			
+			// same checks as a single rename, against the entity's final set of keys, which compare case-insensitively
+			std::vector<std::string> final_keys;
+			for (size_t f = 0; f < field_count(e); f++)
+				final_keys.emplace_back(m_data->key(e, f));
+			for (size_t i = first_edit; i < part.edits.size(); i++) {
+				Edit const & edit = part.edits[i];
+				if ((edit.key && edit.key->empty()) || (edit.value && edit.value->empty())) {
+					if (part.errors.size() < max_errors)
+						part.errors.append(QString { "Entity %1: replacement would leave an empty key or value." }.arg(e));
 				}
-				auto iter = f->data_parent->find(f->key);
-				meadow::istring old_value = iter->second;
-				f->data_parent->erase(iter);
-				f->key = (f->data_parent->emplace(new_value, old_value)).first->first;
-				emit dataChanged(index, index);
-				return true;
+				if (edit.key) final_keys[edit.field] = *edit.key;
 			}
-			case 1: {
-				f->data_parent->at((meadow::istring)f->key) = new_value;
-				emit dataChanged(index, index);
-				return true;
+			for (auto & key : final_keys) fold_case(key);
+			std::sort(final_keys.begin(), final_keys.end());
+			auto dup = std::adjacent_find(final_keys.begin(), final_keys.end());
+			if (dup != final_keys.end() && part.errors.size() < max_errors)
+				part.errors.append(QString { "Entity %1: field \"%2\" already exists." }.arg(e).arg(QString::fromStdString(*dup)));
+		}
+		return part;
+	}, [](Partial & into, Partial && part){
+		into.edits.insert(into.edits.end(), std::make_move_iterator(part.edits.begin()), std::make_move_iterator(part.edits.end()));
+		into.errors.append(part.errors);
+	});
+	
+	if (!found.errors.isEmpty()) {
+		result.errors = found.errors.mid(0, max_errors);
+		return result;
+	}
+	if (found.edits.empty()) return result;
+	
+	emit layoutAboutToBeChanged();
+	
+	// field order is independent of keys, so renames are applied in place and can never collide midway
+	EntityStore & store = detach();
+	for (size_t begin = 0; begin < found.edits.size();) {
+		uint32_t e = found.edits[begin].entity;
+		size_t end = begin;
+		for (; end < found.edits.size() && found.edits[end].entity == e; end++) {
+			Edit const & edit = found.edits[end];
+			if (edit.key) {
+				sort_key_changed(store.key(e, edit.field));
+				store.set_key(e, edit.field, *edit.key);
 			}
-			default: return false;
+			if (edit.value) store.set_value(e, edit.field, *edit.value);
+			sort_key_changed(store.key(e, edit.field));
 		}
+		
+		entity_changed(e);
+		result.entities++;
+		result.fields += end - begin;
+		begin = end;
 	}
 	
-	return false;
+	emit layoutChanged();
+	return result;
+}
+
+QVariant EntityTreeModel::entity_value(size_t entity_index, char const * key) const {
+	auto value = m_data->value_of(entity_index, key);
+	return value ? QString::fromUtf8(value->data(), value->size()) : QVariant {};
+}
+
+void EntityTreeModel::entity_changed(size_t entity_index) {
+	m_links.update(*m_data, entity_index);
+	update_search(entity_index);
+	m_serialized_dirty[entity_index] = true;
+}
+
+void EntityTreeModel::sort_key_changed(std::string_view key) {
+	// only these feed the sort ranks, other edits leave them valid
+	if (EntityStore::iequals(key, "classname")) m_sort_ranks[0].clear();
+	else if (EntityStore::iequals(key, "targetname")) m_sort_ranks[1].clear();
 }
 
-EntityTreeItem * EntityTreeModel::get_item(QModelIndex const & index) const {
-	if (!index.isValid()) return m_root.get();
-	return reinterpret_cast<EntityTreeItem *>(index.internalId());
+void EntityTreeModel::update_search(size_t entity_index) {
+	if (m_search.use_count() > 1) // a snapshot is in use by a filter job
+		m_search = std::make_shared<SearchIndex>(*m_search);
+	std::string & str = (*m_search)[entity_index];
+	str.clear();
+	for (auto const & field : m_data->fields(entity_index)) {
+		str.append(m_data->str(field.key));
+		str.push_back(' ');
+		str.append(m_data->str(field.value));
+		str.push_back(' ');
+	}
+	fold_case(str);
+}
+
+void EntityTreeModel::serialize(size_t entity_index) {
+	std::string & str = m_serialized[entity_index];
+	str.clear();
+	str.append("{\n");
+	for (auto const & field : m_data->fields(entity_index)) {
+		str.push_back('"');
+		str.append(m_data->str(field.key));
+		str.append("\" \"");
+		str.append(m_data->str(field.value));
+		str.append("\"\n");
+	}
+	str.append("}\n");
 }
@@ -1,119 +1,56 @@
 #pragma once
 
+#include "EntityLinks.hh"
+#include "EntityStore.hh"
+
 #include <libbsp.hh>
 
 #include <QAbstractItemModel>
+#include <QStringList>
 
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <vector>
 
-struct EntityTreeItem {
-	EntityTreeItem * parent = nullptr;
-	virtual ~EntityTreeItem() = default;
-	int child_index = 0;
-	std::vector<std::unique_ptr<EntityTreeItem>> children;
-	
-	virtual QVariant get_data(int role, int idx) = 0;
-	virtual Qt::ItemFlags get_flags(int) { 
-		return Qt::ItemIsEnabled;
-	}
-};
-
-struct EntityTreeRoot : public EntityTreeItem {
-	std::shared_ptr<BSPI::EntityArray> source;
-	
-	inline QVariant get_data(int, int) override { return {}; }
+// find and replace across every entity field
+struct EntityBulkReplace {
+	QString find;
+	QString replace; // with regex, may reference captures as \1
+	bool regex = false;
+	bool case_sensitive = false;
+	bool keys = false;
+	bool values = true;
+	QStringList only_keys; // if not empty, only fields with these keys are considered
 };
 
-struct EntityTreeEnt : public EntityTreeItem {
-	BSPI::Entity * data_parent;
-	uint32_t entity_index;
-	
-	inline QVariant get_data(int role, int col) override {
-		switch (role) {
-			default: return {};
-			case Qt::DisplayRole:
-			case Qt::EditRole:
-				switch (col) {
-					case 0: return entity_index;
-					case 1: {
-						auto classname = data_parent->find("classname");
-						return (classname == data_parent->end()) ?
-							QVariant {} :
-							QString::fromStdString( meadow::i2s(classname->second) )
-						;
-					}
-					case 2: {
-						auto targetname = data_parent->find("targetname");
-						return (targetname == data_parent->end()) ?
-							QVariant {} :
-							QString::fromStdString( meadow::i2s(targetname->second) )
-						;
-					}
-					default: return {};
-				}
-			case Qt::UserRole: {
-				if (col != 2) return {};
-				QString sort_str;
-				for (auto const & kvp : *data_parent) {
-					sort_str.append(kvp.first.data());
-					sort_str.append(" ");
-					sort_str.append(kvp.second.data());
-					sort_str.append(" ");
-				}
-				return sort_str;
-			}
-		}
-	}
-	Qt::ItemFlags get_flags(int col) override {
-		if (!col) return Qt::ItemIsEnabled;
-		else return Qt::NoItemFlags;
-	}
-};
-
-struct EntityTreeField : public EntityTreeItem {
-	BSPI::Entity * data_parent;
-	meadow::istring_view key;
-	
-	inline QVariant get_data(int role, int col) override {
-		switch (role) {
-			default: return {};
-			case Qt::DisplayRole:
-			case Qt::EditRole:
-				switch (col) {
-					case 0: return QString::fromStdString( meadow::i2s(key) );
-					case 1: return QString::fromStdString( meadow::i2s(data_parent->at(meadow::istring{key})) );
-					default: return {};
-				}
-			case Qt::UserRole: {
-				if (col != 2) return {};
-				QString sort_str;
-				for (auto const & kvp : *data_parent) {
-					sort_str.append(kvp.first.data());
-					sort_str.append(" ");
-					sort_str.append(kvp.second.data());
-					sort_str.append(" ");
-				}
-				return sort_str;
-			}
-		}
-	}
-	Qt::ItemFlags get_flags(int col) override { 
-		switch (col) {
-			case 0:
-			case 1: return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemNeverHasChildren | Qt::ItemIsEditable;
-			default: return Qt::ItemNeverHasChildren;
-		}
-	}
+struct EntityBulkReplaceResult {
+	size_t entities = 0;
+	size_t fields = 0;
+	QStringList errors; // nothing is changed if any are reported
 };
 
+// two level tree: entities at the top level, their key/value fields below
+// the tree is the flat arrays of an EntityStore, a model index encodes (entity, field) directly:
+// entity rows carry internal id 0, field rows carry their entity index + 1
 class EntityTreeModel : public QAbstractItemModel {
 	Q_OBJECT
 	
 public:
-	EntityTreeModel(BSP::Reader::EntityArray const & ents);
+	// the store is shared, not copied, the model detaches from it before its first edit while it is shared
+	EntityTreeModel(std::shared_ptr<EntityStore> store);
 	~EntityTreeModel() = default;
 	
+	// targetname references, kept current with edits
+	EntityLinks const & links() const { return m_links; }
+	// entity an index of this model belongs to, for entity and field rows alike
+	std::optional<size_t> entity_of(QModelIndex const & index) const;
+	
 	BSP::LumpProviderPtr generate_provider();
+	// writes the entity lump text for the current state of the model,
+	// only entities edited since the last write are re-serialized
+	bool write_entities(QIODevice & dev);
 	
 	// QAbstractItemModel implementations
 	QModelIndex index(int row, int column, QModelIndex const & parent = {}) const override;
@@ -125,11 +62,44 @@ public:
 	bool setData(QModelIndex const &, QVariant const &, int role = Qt::EditRole) override;
 	QVariant headerData(int, Qt::Orientation, int) const override { return {}; }
 	
+	// applies a replacement to all entities at once with a single layout change notification,
+	// rejected entirely if any entity would end up with duplicate or empty keys
+	EntityBulkReplaceResult replace_all(EntityBulkReplace const & op);
+	
+	// lowercase "key value key value " text per entity, kept in sync with edits
+	using SearchIndex = std::vector<std::string>;
+	// immutable snapshot safe to read from other threads, edits copy-on-write away from it
+	std::shared_ptr<SearchIndex const> search_snapshot() const { return m_search; }
+	static void fold_case(std::string & str);
+	
+	// ordering for a sorting proxy without going through data(): entities compare by index or by
+	// precomputed ranks of their folded classname / targetname, fields by folded key or value
+	// ranks are rebuilt on the first sort after an edit to a classname or targetname
+	bool sort_less(QModelIndex const & left, QModelIndex const & right) const;
+	
+	// approximate resident bytes of the entity data and everything derived from it
+	size_t memory_estimate() const;
+	
 private:
-	using Entity = QMap<QString, QString>;
-	using EntityArray = QList<Entity>;
-	std::unique_ptr<EntityTreeRoot> m_root;
-	std::shared_ptr<BSPI::EntityArray> m_data;
+	static constexpr quintptr entity_row_id = 0;
+	
+	std::shared_ptr<EntityStore> m_data;
+	EntityLinks m_links;
+	std::shared_ptr<SearchIndex> m_search;
+	// serialized lump text per entity, valid unless flagged dirty
+	std::vector<std::string> m_serialized;
+	std::vector<uint8_t> m_serialized_dirty;
+	// sort rank per entity for columns 1 and 2, empty until needed or after an edit to the key they sort by
+	mutable std::array<std::vector<uint32_t>, 2> m_sort_ranks;
 	
-	EntityTreeItem * get_item(QModelIndex const &) const;
+	size_t entity_count() const { return m_data->entity_count(); }
+	size_t field_count(size_t entity_index) const { return m_data->field_count(entity_index); }
+	EntityStore & detach();
+	QVariant entity_value(size_t entity_index, char const * key) const;
+	void entity_changed(size_t entity_index);
+	// call for the key of every edited field, and the old key of a renamed one
+	void sort_key_changed(std::string_view key);
+	void update_search(size_t entity_index);
+	void serialize(size_t entity_index);
+	std::vector<uint32_t> const & sort_ranks(int column) const;
 };
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+namespace Format {
+	
+	// snprintf into a string, for short report lines, truncated past 255 characters
+	template <typename ... Args> std::string printf(char const * fmt, Args ... args) {
+		char buf[256];
+		std::snprintf(buf, sizeof(buf), fmt, args ...);
+		return buf;
+	}
+}
@@ -0,0 +1,77 @@
+#include "Hash.hh"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace {
+	
+	constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+	constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+	constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+	constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+	constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+	
+	inline uint64_t read64(uint8_t const * p) {
+		uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+	
+	inline uint32_t read32(uint8_t const * p) {
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+	
+	inline uint64_t round(uint64_t acc, uint64_t input) {
+		acc += input * prime2;
+		acc = std::rotl(acc, 31);
+		return acc * prime1;
+	}
+	
+	inline uint64_t merge(uint64_t acc, uint64_t lane) {
+		acc ^= round(0, lane);
+		return acc * prime1 + prime4;
+	}
+}
+
+uint64_t Hash::hash64(void const * data, size_t len, uint64_t seed) {
+	auto p = static_cast<uint8_t const *>(data);
+	auto const end = p + len;
+	uint64_t h;
+	
+	if (len >= 32) {
+		std::array<uint64_t, 4> lanes { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+		for (auto const limit = end - 32; p <= limit; p += 32) {
+			for (size_t l = 0; l < lanes.size(); l++)
+				lanes[l] = round(lanes[l], read64(p + l * 8));
+		}
+		h = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+		for (uint64_t lane : lanes) h = merge(h, lane);
+	} else {
+		h = seed + prime5;
+	}
+	h += len;
+	
+	for (; end - p >= 8; p += 8) {
+		h ^= round(0, read64(p));
+		h = std::rotl(h, 27) * prime1 + prime4;
+	}
+	if (end - p >= 4) {
+		h ^= read32(p) * prime1;
+		h = std::rotl(h, 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * prime5;
+		h = std::rotl(h, 11) * prime1;
+	}
+	
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Hash {
+	
+	// 64-bit non-cryptographic hash with the XXH64 structure: four independent 8 byte lanes per 32 byte stripe,
+	// so the main loop carries no dependency between lanes and keeps several multipliers (or vector lanes) busy
+	// results assume little endian input, as do the lumps themselves
+	uint64_t hash64(void const * data, size_t len, uint64_t seed = 0);
+}
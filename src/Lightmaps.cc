@@ -0,0 +1,166 @@
+#include "Lightmaps.hh"
+#include "MappedFile.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+LightmapModel::LightmapModel(QObject * parent) : QAbstractListModel { parent } {
+	m_thumbnails.setMaxCost(default_thumbnail_cache_mb * 1024 * 1024);
+	m_pages.setMaxCost(default_page_cache_mb * 1024 * 1024);
+	m_placeholder = QImage { thumbnail_size, thumbnail_size, QImage::Format_RGB888 };
+	m_placeholder.fill(Qt::darkGray);
+}
+
+void LightmapModel::set_source(std::shared_ptr<MappedFile> file, RawBSP const & raw) {
+	beginResetModel();
+	m_generation++;
+	m_file = std::move(file);
+	m_lump = raw.lump(RBSP::LIGHTMAPS);
+	m_count = m_lump.size() / sizeof(RBSP::Lightmap);
+	m_thumbnails.clear();
+	m_pages.clear();
+	m_pending.clear();
+	m_requested_thumbnail.assign(m_count, false);
+	endResetModel();
+}
+
+void LightmapModel::clear_cache() {
+	m_generation++;
+	m_thumbnails.clear();
+	m_pages.clear();
+	m_pending.clear();
+	std::fill(m_requested_thumbnail.begin(), m_requested_thumbnail.end(), false);
+	if (m_count) emit dataChanged(index(0), index(m_count - 1), { Qt::DecorationRole });
+}
+
+void LightmapModel::set_overbright(bool overbright) {
+	if (overbright == m_overbright) return;
+	m_overbright = overbright;
+	clear_cache();
+}
+
+void LightmapModel::request_page(int row) {
+	if (row < 0 || row >= m_count) return;
+	if (QImage * page = m_pages.object(row)) {
+		emit page_ready(row, *page);
+		return;
+	}
+	enqueue({ row, true });
+}
+
+QImage LightmapModel::wrap(std::shared_ptr<MappedFile> const & file, uint8_t const * pixels) {
+	constexpr int size = RBSP::lightmap_size;
+	return QImage { pixels, size, size, size * 3, QImage::Format_RGB888, [](void * info){
+		delete static_cast<std::shared_ptr<MappedFile> *>(info);
+	}, new std::shared_ptr<MappedFile> { file } };
+}
+
+QImage LightmapModel::decode(std::shared_ptr<MappedFile> const & file, uint8_t const * pixels, bool overbright) {
+	if (!overbright) return wrap(file, pixels);
+	
+	// shifted like the game does, scaling the whole color back into range rather than clamping channels
+	constexpr int size = RBSP::lightmap_size;
+	QImage image { size, size, QImage::Format_RGB888 };
+	for (int y = 0; y < size; y++) {
+		uint8_t const * src = pixels + y * size * 3;
+		uchar * dst = image.scanLine(y);
+		for (int x = 0; x < size * 3; x += 3) {
+			int r = src[x] << 1, g = src[x + 1] << 1, b = src[x + 2] << 1;
+			int max = std::max({ r, g, b });
+			if (max > 255) {
+				r = r * 255 / max;
+				g = g * 255 / max;
+				b = b * 255 / max;
+			}
+			dst[x] = r;
+			dst[x + 1] = g;
+			dst[x + 2] = b;
+		}
+	}
+	return image;
+}
+
+int LightmapModel::rowCount(QModelIndex const & parent) const {
+	if (parent.isValid()) return 0;
+	return m_count;
+}
+
+QVariant LightmapModel::data(QModelIndex const & index, int role) const {
+	if (!index.isValid() || index.row() >= m_count) return {};
+	int row = index.row();
+	switch (role) {
+		default: return {};
+		case Qt::DisplayRole: return QString::number(row);
+		case Qt::ToolTipRole: return QString { "Lightmap %1" }.arg(row);
+		case Qt::DecorationRole:
+			if (QImage * thumbnail = m_thumbnails.object(row)) return *thumbnail;
+			if (!m_requested_thumbnail[row]) {
+				m_requested_thumbnail[row] = true;
+				enqueue({ row, false });
+			}
+			return m_placeholder;
+	}
+}
+
+void LightmapModel::enqueue(Request request) const {
+	m_pending.push_back(request);
+	if (m_job_running || m_job_scheduled) return;
+	// requests made during one paint are collected into a single batch
+	m_job_scheduled = true;
+	auto self = const_cast<LightmapModel *>(this);
+	QMetaObject::invokeMethod(self, [self](){ self->start_job(); }, Qt::QueuedConnection);
+}
+
+void LightmapModel::start_job() {
+	m_job_scheduled = false;
+	if (m_job_running || m_pending.empty()) return;
+	m_job_running = true;
+	
+	struct Decoded {
+		Request request;
+		QImage image;
+	};
+	std::vector<Request> batch = std::move(m_pending);
+	m_pending.clear();
+	uint64_t generation = m_generation;
+	std::shared_ptr<MappedFile> file = m_file;
+	uint8_t const * pixels = m_lump.data();
+	bool overbright = m_overbright;
+	
+	auto watcher = new QFutureWatcher<std::vector<Decoded>> { this };
+	connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generation](){
+		watcher->deleteLater();
+		m_job_running = false;
+		if (generation == m_generation) {
+			for (auto & decoded : watcher->result()) {
+				int row = decoded.request.row;
+				int cost = decoded.image.sizeInBytes();
+				if (decoded.request.full) {
+					emit page_ready(row, decoded.image);
+					m_pages.insert(row, new QImage { std::move(decoded.image) }, cost);
+				} else {
+					m_thumbnails.insert(row, new QImage { std::move(decoded.image) }, cost);
+					m_requested_thumbnail[row] = false; // asked for again if evicted
+					emit dataChanged(index(row), index(row), { Qt::DecorationRole });
+				}
+			}
+		}
+		if (!m_pending.empty()) start_job();
+	});
+	
+	watcher->setFuture(QtConcurrent::run([batch, file, pixels, overbright](){
+		Trace::Scope trace { "decode lightmaps" };
+		std::vector<Decoded> decoded;
+		decoded.reserve(batch.size());
+		for (Request const & request : batch) {
+			QImage image = decode(file, pixels + request.row * sizeof(RBSP::Lightmap), overbright);
+			if (!request.full) image = image.scaled(thumbnail_size, thumbnail_size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			decoded.push_back({ request, std::move(image) });
+		}
+		return decoded;
+	}));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "RawBSP.hh"
+
+#include <QAbstractListModel>
+#include <QCache>
+#include <QImage>
+
+#include <memory>
+#include <vector>
+
+class MappedFile;
+
+// lightmap pages of a map, one row each, decoded on demand
+// views only ask for the rows they show, so pages are decoded as they scroll into view, a batch at a time on a worker
+// decoded thumbnails and full pages live in size-bounded LRU caches, evicted pages are simply decoded again
+class LightmapModel : public QAbstractListModel {
+	Q_OBJECT
+	
+public:
+	static constexpr int thumbnail_size = 64;
+	static constexpr int default_thumbnail_cache_mb = 16;
+	static constexpr int default_page_cache_mb = 32;
+	
+	LightmapModel(QObject * parent = nullptr);
+	
+	// pages are read from the mapping in place, the file is kept mapped while any image still refers to it
+	void set_source(std::shared_ptr<MappedFile> file, RawBSP const & raw);
+	// drops decoded images, e.g. while the document is in the background
+	void clear_cache();
+	
+	// lightmaps are stored without the overbright shift the game applies, showing them shifted is closer to what the game shows
+	bool overbright() const { return m_overbright; }
+	void set_overbright(bool overbright);
+	
+	// full page, emitted through page_ready immediately from the cache or once decoded
+	void request_page(int row);
+	
+	// an image sharing the page's pixels in the mapping, no copy is made unless it is written to
+	static QImage wrap(std::shared_ptr<MappedFile> const & file, uint8_t const * pixels);
+	static QImage decode(std::shared_ptr<MappedFile> const & file, uint8_t const * pixels, bool overbright);
+	
+	// QAbstractItemModel implementations
+	int rowCount(QModelIndex const & parent = {}) const override;
+	QVariant data(QModelIndex const & index, int role = Qt::DisplayRole) const override;
+	
+signals:
+	void page_ready(int row, QImage image);
+	
+private:
+	struct Request {
+		int row;
+		bool full;
+	};
+	
+	std::shared_ptr<MappedFile> m_file;
+	std::span<uint8_t const> m_lump;
+	int m_count = 0;
+	bool m_overbright = true;
+	
+	mutable QCache<int, QImage> m_thumbnails;
+	QCache<int, QImage> m_pages;
+	
+	// rows asked for and not yet decoded, the next batch starts once the running one is done
+	mutable std::vector<Request> m_pending;
+	mutable std::vector<uint8_t> m_requested_thumbnail; // per row, so repeated paints queue a row once
+	mutable bool m_job_running = false;
+	mutable bool m_job_scheduled = false;
+	uint64_t m_generation = 0; // bumped when decoded results would no longer apply
+	QImage m_placeholder;
+	
+	void enqueue(Request request) const;
+	void start_job();
+};
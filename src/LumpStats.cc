@@ -0,0 +1,46 @@
+#include "LumpStats.hh"
+
+std::array<char const *, LumpStats::lump_count> const LumpStats::names {
+	"Entities",
+	"Shaders",
+	"Planes",
+	"Nodes",
+	"Leafs",
+	"Leaf Surfaces",
+	"Leaf Brushes",
+	"Brush Models",
+	"Brushes",
+	"Brush Sides",
+	"Draw Verts",
+	"Draw Indices",
+	"Fogs",
+	"Surfaces",
+	"Lightmaps",
+	"Lightgrid Elements",
+	"Visibility Clusters",
+	"Lightarray Elements",
+};
+
+LumpStats LumpStats::compute(BSP::Reader & bspr, size_t entity_count) {
+	LumpStats stats;
+	stats.counts[0] = entity_count;
+	stats.counts[1] = bspr.shaders().size();
+	stats.counts[2] = bspr.planes().size();
+	stats.counts[3] = bspr.nodes().size();
+	stats.counts[4] = bspr.leafs().size();
+	stats.counts[5] = bspr.leafsurfaces().size();
+	stats.counts[6] = bspr.leafbrushes().size();
+	stats.counts[7] = bspr.models().size();
+	stats.counts[8] = bspr.brushes().size();
+	stats.counts[9] = bspr.brushsides().size();
+	stats.counts[10] = bspr.drawverts().size();
+	stats.counts[11] = bspr.drawindices().size();
+	stats.counts[12] = bspr.fogs().size();
+	stats.counts[13] = bspr.surfaces().size();
+	stats.counts[14] = bspr.lightmaps().size();
+	stats.counts[15] = bspr.lightgrids().size();
+	stats.has_visibility = bspr.has_visibility();
+	stats.counts[16] = stats.has_visibility ? bspr.visibility().header.clusters : 0;
+	stats.counts[17] = bspr.lightarray().size();
+	return stats;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <libbsp.hh>
+
+#include <array>
+#include <cstdint>
+
+// per-lump element counts, in on-disk lump order
+struct LumpStats {
+	static constexpr size_t lump_count = 18;
+	static std::array<char const *, lump_count> const names;
+	
+	std::array<int64_t, lump_count> counts {};
+	bool has_visibility = false;
+	
+	static LumpStats compute(BSP::Reader & bspr, size_t entity_count);
+};
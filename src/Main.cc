@@ -1,13 +1,27 @@
+#include "Batch.hh"
 #include "BSPReaderWin.hh"
+#include "Trace.hh"
 
 #include <QApplication>
+#include <QCoreApplication>
 
 int main(int argc, char * * argv) {
 	
+	Trace::init_from_env();
+	
+	if (Batch::requested(argc, argv)) {
+		QCoreApplication app { argc, argv };
+		int ret = Batch::run(app.arguments());
+		Trace::finish();
+		return ret;
+	}
+	
 	QApplication app { argc, argv };
 	
 	BSPReaderWindow * win = new BSPReaderWindow;
 	win->show();
 	
-	return app.exec();
+	int ret = app.exec();
+	Trace::finish();
+	return ret;
 }
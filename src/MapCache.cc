@@ -0,0 +1,46 @@
+#include "MapCache.hh"
+#include "EntityTree.hh"
+
+size_t ParsedMap::memory_estimate() const {
+	size_t bytes = sizeof(ParsedMap);
+	for (auto const & entry : classes)
+		bytes += sizeof(entry) + entry.classname.size() * sizeof(QChar);
+	for (auto const & entry : shaders)
+		bytes += sizeof(entry) + entry.shader.size() * sizeof(QChar);
+	if (visibility) bytes += visibility->memory_estimate();
+	if (model) bytes += model->memory_estimate();
+	return bytes;
+}
+
+std::shared_ptr<ParsedMap> MapCache::get(QString const & key) {
+	auto iter = m_index.find(key);
+	if (iter == m_index.end()) return nullptr;
+	m_entries.splice(m_entries.begin(), m_entries, *iter);
+	return m_entries.front().map;
+}
+
+void MapCache::put(QString const & key, std::shared_ptr<ParsedMap> map) {
+	remove(key);
+	size_t cost = map->memory_estimate();
+	m_entries.push_front({ key, std::move(map), cost });
+	m_index.insert(key, m_entries.begin());
+	m_used += cost;
+	evict();
+}
+
+void MapCache::remove(QString const & key) {
+	auto iter = m_index.find(key);
+	if (iter == m_index.end()) return;
+	m_used -= (*iter)->cost;
+	m_entries.erase(*iter);
+	m_index.erase(iter);
+}
+
+void MapCache::evict() {
+	while (m_used > m_capacity && !m_entries.empty()) {
+		Entry const & lru = m_entries.back();
+		m_used -= lru.cost;
+		m_index.remove(lru.key);
+		m_entries.pop_back();
+	}
+}
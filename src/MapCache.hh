@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ClassHistogram.hh"
+#include "LumpStats.hh"
+#include "ShaderStats.hh"
+#include "Visibility.hh"
+
+#include <QHash>
+#include <QString>
+
+#include <list>
+#include <memory>
+#include <optional>
+
+class EntityTreeModel;
+
+// everything derived from a map by the load pipeline
+struct ParsedMap {
+	LumpStats stats;
+	ClassHistogramModel::Histogram classes;
+	ShaderStatsModel::Stats shaders;
+	std::optional<Visibility::Analysis> visibility;
+	std::shared_ptr<EntityTreeModel> model;
+	
+	size_t memory_estimate() const;
+};
+
+// least recently used parsed maps, keyed by MappedFile::key, bounded by estimated memory
+// only unedited state may be cached, GUI thread only
+class MapCache {
+public:
+	MapCache(size_t capacity_bytes) : m_capacity { capacity_bytes } {}
+	
+	// null on miss, a hit becomes the most recently used entry
+	std::shared_ptr<ParsedMap> get(QString const & key);
+	// evicts least recently used entries until within capacity
+	void put(QString const & key, std::shared_ptr<ParsedMap> map);
+	void remove(QString const & key);
+	
+	size_t capacity() const { return m_capacity; }
+	size_t used() const { return m_used; }
+	
+private:
+	struct Entry {
+		QString key;
+		std::shared_ptr<ParsedMap> map;
+		size_t cost;
+	};
+	size_t m_capacity;
+	size_t m_used = 0;
+	std::list<Entry> m_entries; // most recently used first
+	QHash<QString, std::list<Entry>::iterator> m_index;
+	
+	void evict();
+};
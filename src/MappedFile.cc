@@ -0,0 +1,53 @@
+#include "MappedFile.hh"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+
+#include <mutex>
+
+namespace {
+	std::mutex registry_mut;
+	QHash<QString, std::weak_ptr<MappedFile>> registry;
+}
+
+QString MappedFile::key_for(QString const & path) {
+	QFileInfo info { path };
+	return info.canonicalFilePath() + '|' + QString::number(info.size()) + '|' + QString::number(info.lastModified().toMSecsSinceEpoch());
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(QString const & path, QString & error) {
+	QFileInfo info { path };
+	if (!info.exists() || !info.isFile()) {
+		error = "Specified file does not exist.";
+		return nullptr;
+	}
+	QString key = key_for(path);
+	
+	std::lock_guard lock { registry_mut };
+	if (auto existing = registry.value(key).lock()) return existing;
+	
+	std::shared_ptr<MappedFile> mf { new MappedFile };
+	mf->m_path = info.canonicalFilePath();
+	mf->m_key = key;
+	mf->m_file.setFileName(mf->m_path);
+	if (mf->m_file.open(QIODevice::ReadOnly))
+		mf->m_map = mf->m_file.map(0, info.size(), QFileDevice::MapPrivateOption);
+	if (!mf->m_map) {
+		error = "Unable to open or map specified file.";
+		return nullptr;
+	}
+	mf->m_size = info.size();
+	
+	// drop registry entries of mappings that have since been released
+	for (auto iter = registry.begin(); iter != registry.end();) {
+		if (iter->expired()) iter = registry.erase(iter);
+		else iter++;
+	}
+	registry.insert(key, mf);
+	return mf;
+}
+
+MappedFile::~MappedFile() {
+	if (m_map) m_file.unmap(m_map);
+}
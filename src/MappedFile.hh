@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QFile>
+#include <QString>
+
+#include <memory>
+
+// read-only private mapping of a whole file
+// mappings are shared: opening a file that is already mapped, unchanged on disk, returns the existing mapping
+class MappedFile {
+public:
+	// null on failure, with error describing the cause
+	static std::shared_ptr<MappedFile> open(QString const & path, QString & error);
+	~MappedFile();
+	
+	MappedFile(MappedFile const &) = delete;
+	MappedFile & operator = (MappedFile const &) = delete;
+	
+	uint8_t const * data() const { return m_map; }
+	size_t size() const { return m_size; }
+	QString const & path() const { return m_path; }
+	
+	// identifies this version of the file: canonical path, size and modification time
+	QString const & key() const { return m_key; }
+	static QString key_for(QString const & path);
+	
+private:
+	MappedFile() = default;
+	
+	QFile m_file;
+	uint8_t * m_map = nullptr;
+	size_t m_size = 0;
+	QString m_path;
+	QString m_key;
+};
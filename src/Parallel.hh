@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// chunked data parallelism on the global thread pool
+// blocking calls made from a pool thread also run work on the calling thread, so nesting is safe
+namespace Parallel {
+	
+	struct Range {
+		size_t begin;
+		size_t end;
+	};
+	
+	// splits [0, count) into a few chunks per pool thread, none smaller than min_chunk
+	inline std::vector<Range> chunks(size_t count, size_t min_chunk) {
+		size_t threads = std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+		size_t chunk_count = std::clamp<size_t>(count / std::max<size_t>(min_chunk, 1), 1, threads * 4);
+		size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+		std::vector<Range> ranges;
+		ranges.reserve(chunk_count);
+		for (size_t begin = 0; begin < count; begin += chunk_size)
+			ranges.push_back({ begin, std::min(begin + chunk_size, count) });
+		if (ranges.empty()) ranges.push_back({ 0, 0 });
+		return ranges;
+	}
+	
+	// fn(Range) for every chunk of [0, count), returns once all are done
+	template <typename F> void for_chunks(size_t count, size_t min_chunk, F const & fn) {
+		auto ranges = chunks(count, min_chunk);
+		if (ranges.size() == 1) {
+			fn(ranges.front());
+			return;
+		}
+		QtConcurrent::blockingMap(ranges, [&fn](Range const & r){ fn(r); });
+	}
+	
+	// map(Range) -> T for every chunk, then combine(T & into, T && partial) in chunk order
+	template <typename T, typename M, typename C> T reduce_chunks(size_t count, size_t min_chunk, M const & map, C const & combine) {
+		auto ranges = chunks(count, min_chunk);
+		std::vector<T> partials (ranges.size());
+		std::vector<size_t> ids (ranges.size());
+		std::iota(ids.begin(), ids.end(), 0);
+		if (ranges.size() == 1) partials.front() = map(ranges.front());
+		else QtConcurrent::blockingMap(ids, [&](size_t id){ partials[id] = map(ranges[id]); });
+		
+		T result = std::move(partials.front());
+		for (size_t i = 1; i < partials.size(); i++)
+			combine(result, std::move(partials[i]));
+		return result;
+	}
+}
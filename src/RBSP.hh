@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// on-disk RBSP lump element layouts, for reading lumps straight from a RawBSP
+namespace RBSP {
+	
+	enum LumpIndex : size_t {
+		ENTITIES,
+		SHADERS,
+		PLANES,
+		NODES,
+		LEAFS,
+		LEAFSURFACES,
+		LEAFBRUSHES,
+		MODELS,
+		BRUSHES,
+		BRUSHSIDES,
+		DRAWVERTS,
+		DRAWINDEXES,
+		FOGS,
+		SURFACES,
+		LIGHTMAPS,
+		LIGHTGRID,
+		VISIBILITY,
+		LIGHTARRAY,
+	};
+	
+	constexpr size_t max_lightmaps = 4;
+	constexpr size_t lightmap_size = 128;
+	
+	struct Shader {
+		char name[64];
+		int32_t surface_flags;
+		int32_t content_flags;
+	};
+	
+	struct Plane {
+		float normal[3];
+		float dist;
+	};
+	
+	struct Node {
+		int32_t plane;
+		int32_t children[2]; // negative numbers are -(leaf + 1)
+		int32_t mins[3];
+		int32_t maxs[3];
+	};
+	
+	struct Leaf {
+		int32_t cluster; // -1 is opaque
+		int32_t area;
+		int32_t mins[3];
+		int32_t maxs[3];
+		int32_t first_leaf_surface;
+		int32_t num_leaf_surfaces;
+		int32_t first_leaf_brush;
+		int32_t num_leaf_brushes;
+	};
+	
+	struct Model {
+		float mins[3];
+		float maxs[3];
+		int32_t first_surface;
+		int32_t num_surfaces;
+		int32_t first_brush;
+		int32_t num_brushes;
+	};
+	
+	struct Brush {
+		int32_t first_side;
+		int32_t num_sides;
+		int32_t shader;
+	};
+	
+	struct BrushSide {
+		int32_t plane;
+		int32_t shader;
+		int32_t draw_surface; // -1 if none
+	};
+	
+	struct DrawVert {
+		float xyz[3];
+		float st[2];
+		float lightmap[max_lightmaps][2];
+		float normal[3];
+		uint8_t color[max_lightmaps][4];
+	};
+	
+	struct Fog {
+		char shader[64];
+		int32_t brush;
+		int32_t visible_side; // -1 for none
+	};
+	
+	struct Surface {
+		int32_t shader;
+		int32_t fog; // -1 for none
+		int32_t surface_type;
+		int32_t first_vert;
+		int32_t num_verts;
+		int32_t first_index;
+		int32_t num_indexes;
+		uint8_t lightmap_styles[max_lightmaps];
+		uint8_t vertex_styles[max_lightmaps];
+		int32_t lightmap_num[max_lightmaps];
+		int32_t lightmap_x[max_lightmaps];
+		int32_t lightmap_y[max_lightmaps];
+		int32_t lightmap_width;
+		int32_t lightmap_height;
+		float lightmap_origin[3];
+		float lightmap_vecs[3][3];
+		int32_t patch_width;
+		int32_t patch_height;
+	};
+	
+	struct Lightmap {
+		uint8_t rgb[lightmap_size][lightmap_size][3];
+	};
+	
+	struct LightGrid {
+		uint8_t ambient[max_lightmaps][3];
+		uint8_t directed[max_lightmaps][3];
+		uint8_t styles[max_lightmaps];
+		uint8_t lat_long[2];
+	};
+	
+	// the visibility lump is this header followed by cluster_bytes of bits per cluster
+	struct VisibilityHeader {
+		int32_t num_clusters;
+		int32_t cluster_bytes;
+	};
+	
+	static_assert(sizeof(Shader) == 72);
+	static_assert(sizeof(Plane) == 16);
+	static_assert(sizeof(Node) == 36);
+	static_assert(sizeof(Leaf) == 48);
+	static_assert(sizeof(Model) == 40);
+	static_assert(sizeof(Brush) == 12);
+	static_assert(sizeof(BrushSide) == 12);
+	static_assert(sizeof(DrawVert) == 80);
+	static_assert(sizeof(Fog) == 72);
+	static_assert(sizeof(Surface) == 148);
+	static_assert(sizeof(Lightmap) == 128 * 128 * 3);
+	static_assert(sizeof(LightGrid) == 30);
+}
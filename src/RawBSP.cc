@@ -0,0 +1,20 @@
+#include "RawBSP.hh"
+
+#include <cstring>
+
+bool RawBSP::rebase(uint8_t const * data, size_t size) {
+	m_data = nullptr;
+	m_size = 0;
+	if (!data || size < sizeof(Header)) return false;
+	
+	Header const & head = *reinterpret_cast<Header const *>(data);
+	if (std::memcmp(head.ident, ident, sizeof(ident)) || head.version != version) return false;
+	for (Lump const & l : head.lumps) {
+		if (l.offset < 0 || l.length < 0) return false;
+		if (static_cast<size_t>(l.offset) + static_cast<size_t>(l.length) > size) return false;
+	}
+	
+	m_data = data;
+	m_size = size;
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+
+// direct view of the on-disk lump directory of a mapped BSP, without parsing any lump
+struct RawBSP {
+	static constexpr size_t lump_count = 18;
+	static constexpr char ident[4] { 'R', 'B', 'S', 'P' };
+	static constexpr int32_t version = 1;
+	
+	struct Lump {
+		int32_t offset;
+		int32_t length;
+	};
+	
+	struct Header {
+		char ident[4];
+		int32_t version;
+		std::array<Lump, lump_count> lumps;
+	};
+	static_assert(sizeof(Header) == 8 + lump_count * 8);
+	
+	// false if the data is too small for a header, is not an RBSP of the supported version,
+	// or any lump lies outside of it
+	bool rebase(uint8_t const * data, size_t size);
+	
+	uint8_t const * data() const { return m_data; }
+	size_t size() const { return m_size; }
+	Header const & header() const { return *reinterpret_cast<Header const *>(m_data); }
+	
+	std::span<uint8_t const> lump(size_t idx) const {
+		Lump const & l = header().lumps[idx];
+		return { m_data + l.offset, static_cast<size_t>(l.length) };
+	}
+	
+	// lump as an array of T, trailing partial elements are ignored
+	template <typename T> std::span<T const> lump_as(size_t idx) const {
+		auto bytes = lump(idx);
+		return { reinterpret_cast<T const *>(bytes.data()), bytes.size() / sizeof(T) };
+	}
+	
+private:
+	uint8_t const * m_data = nullptr;
+	size_t m_size = 0;
+};
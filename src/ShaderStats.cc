@@ -0,0 +1,113 @@
+#include "ShaderStats.hh"
+#include "Parallel.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+
+#include <algorithm>
+#include <cstring>
+
+ShaderStatsModel::Stats ShaderStatsModel::compute(RawBSP const & raw) {
+	Trace::Scope trace { "shader stats" };
+	
+	// chunks accumulate into plain counter arrays, names are only attached at the end
+	struct Counts {
+		std::vector<qulonglong> surfaces, draw_verts, draw_indexes, brush_sides;
+	};
+	auto shaders = raw.lump_as<RBSP::Shader>(RBSP::SHADERS);
+	auto surfaces = raw.lump_as<RBSP::Surface>(RBSP::SURFACES);
+	auto brush_sides = raw.lump_as<RBSP::BrushSide>(RBSP::BRUSHSIDES);
+	size_t shader_count = shaders.size();
+	
+	auto combine = [](std::vector<qulonglong> & into, std::vector<qulonglong> const & part){
+		for (size_t i = 0; i < into.size(); i++) into[i] += part[i];
+	};
+	
+	Counts counts = Parallel::reduce_chunks<Counts>(surfaces.size(), 16 * 1024, [&](Parallel::Range r){
+		Counts part { std::vector<qulonglong>(shader_count), std::vector<qulonglong>(shader_count), std::vector<qulonglong>(shader_count), {} };
+		for (size_t i = r.begin; i < r.end; i++) {
+			RBSP::Surface const & s = surfaces[i];
+			if (static_cast<uint32_t>(s.shader) >= shader_count) continue;
+			part.surfaces[s.shader]++;
+			part.draw_verts[s.shader] += std::max(s.num_verts, 0);
+			part.draw_indexes[s.shader] += std::max(s.num_indexes, 0);
+		}
+		return part;
+	}, [&](Counts & into, Counts && part){
+		combine(into.surfaces, part.surfaces);
+		combine(into.draw_verts, part.draw_verts);
+		combine(into.draw_indexes, part.draw_indexes);
+	});
+	
+	counts.brush_sides = Parallel::reduce_chunks<std::vector<qulonglong>>(brush_sides.size(), 16 * 1024, [&](Parallel::Range r){
+		std::vector<qulonglong> part (shader_count);
+		for (size_t i = r.begin; i < r.end; i++) {
+			int32_t shader = brush_sides[i].shader;
+			if (static_cast<uint32_t>(shader) < shader_count) part[shader]++;
+		}
+		return part;
+	}, [&](std::vector<qulonglong> & into, std::vector<qulonglong> && part){
+		combine(into, part);
+	});
+	
+	Stats stats (shader_count);
+	for (size_t i = 0; i < shader_count; i++) {
+		char const * name = shaders[i].name;
+		stats[i] = {
+			QString::fromLatin1(name, strnlen(name, sizeof(shaders[i].name))),
+			counts.surfaces[i],
+			counts.draw_verts[i],
+			counts.draw_indexes[i],
+			counts.brush_sides[i],
+		};
+	}
+	return stats;
+}
+
+void ShaderStatsModel::set_stats(Stats stats) {
+	beginResetModel();
+	m_stats = std::move(stats);
+	endResetModel();
+}
+
+int ShaderStatsModel::rowCount(QModelIndex const & parent) const {
+	if (parent.isValid()) return 0;
+	return m_stats.size();
+}
+
+int ShaderStatsModel::columnCount(QModelIndex const & parent) const {
+	if (parent.isValid()) return 0;
+	return 5;
+}
+
+QVariant ShaderStatsModel::data(QModelIndex const & index, int role) const {
+	if (!index.isValid() || index.row() >= (int)m_stats.size()) return {};
+	Entry const & entry = m_stats[index.row()];
+	switch (role) {
+		default: return {};
+		case Qt::DisplayRole:
+			switch (index.column()) {
+				default: return {};
+				case 0: return entry.shader;
+				case 1: return entry.surfaces;
+				case 2: return entry.draw_verts;
+				case 3: return entry.draw_indexes;
+				case 4: return entry.brush_sides;
+			}
+		case Qt::TextAlignmentRole:
+			if (index.column()) return QVariant { Qt::AlignRight | Qt::AlignVCenter };
+			return {};
+	}
+}
+
+QVariant ShaderStatsModel::headerData(int section, Qt::Orientation orientation, int role) const {
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole) return {};
+	switch (section) {
+		default: return {};
+		case 0: return "Shader";
+		case 1: return "Surfaces";
+		case 2: return "Draw Verts";
+		case 3: return "Draw Indices";
+		case 4: return "Brush Sides";
+	}
+}
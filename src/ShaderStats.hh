@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QAbstractTableModel>
+
+#include <vector>
+
+struct RawBSP;
+
+// per shader usage by surfaces and brush sides, for the Shaders tab
+class ShaderStatsModel : public QAbstractTableModel {
+	Q_OBJECT
+	
+public:
+	struct Entry {
+		QString shader;
+		qulonglong surfaces = 0;
+		qulonglong draw_verts = 0;
+		qulonglong draw_indexes = 0;
+		qulonglong brush_sides = 0;
+	};
+	using Stats = std::vector<Entry>; // indexed by shader
+	
+	ShaderStatsModel(QObject * parent = nullptr) : QAbstractTableModel { parent } {}
+	
+	// parallel reduction over surfaces and brush sides, references to missing shaders are skipped,
+	// safe to call from any thread
+	static Stats compute(RawBSP const & raw);
+	void set_stats(Stats stats);
+	
+	// QAbstractItemModel implementations
+	int rowCount(QModelIndex const & parent = {}) const override;
+	int columnCount(QModelIndex const & parent = {}) const override;
+	QVariant data(QModelIndex const & index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+	
+private:
+	Stats m_stats;
+};
@@ -0,0 +1,108 @@
+#include "Trace.hh"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <map>
+#include <thread>
+
+std::atomic_bool Trace::g_enabled { false };
+
+namespace {
+	
+	struct Event {
+		char const * name;
+		Trace::Clock::time_point start;
+		Trace::Clock::duration dur;
+		int tid;
+	};
+	
+	std::mutex g_mut;
+	std::vector<Event> g_events;
+	std::map<std::thread::id, int> g_tids;
+	Trace::Clock::time_point const g_epoch = Trace::Clock::now();
+	QString g_env_path;
+	
+	void record(char const * name, Trace::Clock::time_point start, Trace::Clock::duration dur) {
+		std::lock_guard lock { g_mut };
+		auto [iter, inserted] = g_tids.try_emplace(std::this_thread::get_id(), g_tids.size() + 1);
+		g_events.push_back({ name, start, dur, iter->second });
+	}
+	
+	qint64 to_us(Trace::Clock::duration dur) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(dur).count();
+	}
+	
+	qint64 to_ms(Trace::Clock::duration dur) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(dur).count();
+	}
+}
+
+void Trace::set_enabled(bool v) {
+	g_enabled = v;
+}
+
+void Trace::clear() {
+	std::lock_guard lock { g_mut };
+	g_events.clear();
+}
+
+bool Trace::export_json(QString const & path) {
+	QJsonArray events;
+	{
+		std::lock_guard lock { g_mut };
+		for (auto const & e : g_events) {
+			QJsonObject obj;
+			obj["name"] = e.name;
+			obj["ph"] = "X";
+			obj["ts"] = to_us(e.start - g_epoch);
+			obj["dur"] = to_us(e.dur);
+			obj["pid"] = 1;
+			obj["tid"] = e.tid;
+			events.append(obj);
+		}
+	}
+	QJsonObject root;
+	root["traceEvents"] = events;
+	root["displayTimeUnit"] = "ms";
+	QByteArray json = QJsonDocument { root }.toJson(QJsonDocument::Compact);
+	
+	QFile f { path };
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+	return f.write(json) == json.size();
+}
+
+void Trace::init_from_env() {
+	g_env_path = qEnvironmentVariable("BSPIUM_TRACE");
+	if (!g_env_path.isEmpty()) set_enabled(true);
+}
+
+void Trace::finish() {
+	if (g_env_path.isEmpty()) return;
+	export_json(g_env_path);
+}
+
+void Trace::PhaseLog::add(char const * phase, Clock::duration dur) {
+	std::lock_guard lock { m_mut };
+	m_phases.emplace_back(phase, dur);
+}
+
+QString Trace::PhaseLog::summary() const {
+	std::lock_guard lock { m_mut };
+	QString str = QString { "%1: %2 ms" }.arg(m_operation).arg(to_ms(Clock::now() - m_start));
+	if (m_phases.empty()) return str;
+	QStringList phases;
+	for (auto const & [phase, dur] : m_phases)
+		phases.append(QString { "%1 %2 ms" }.arg(phase).arg(to_ms(dur)));
+	return str + " (" + phases.join(", ") + ")";
+}
+
+Trace::Scope::~Scope() {
+	if (m_start == Clock::time_point {}) return;
+	auto dur = Clock::now() - m_start;
+	if (m_log) m_log->add(m_name, dur);
+	if (enabled()) record(m_name, m_start, dur);
+}
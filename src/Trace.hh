@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// scoped timing spans for open/parse/model/save phases
+// spans are only recorded for export while tracing is enabled, otherwise a scope without a phase log costs one atomic load
+namespace Trace {
+	
+	using Clock = std::chrono::steady_clock;
+	
+	extern std::atomic_bool g_enabled;
+	inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+	void set_enabled(bool);
+	void clear();
+	
+	// Chrome/Perfetto trace event JSON of all recorded spans
+	bool export_json(QString const & path);
+	
+	// BSPIUM_TRACE=<path> enables tracing at startup and exports to path on finish()
+	void init_from_env();
+	void finish();
+	
+	// phase timings of a single operation, for the status bar, filled from any thread
+	class PhaseLog {
+	public:
+		PhaseLog(QString operation) : m_operation { operation }, m_start { Clock::now() } {}
+		
+		void add(char const * phase, Clock::duration dur);
+		// e.g. "Open: 812 ms (parse entities 640 ms, build model 150 ms)"
+		QString summary() const;
+		
+	private:
+		QString m_operation;
+		Clock::time_point m_start;
+		mutable std::mutex m_mut;
+		std::vector<std::pair<char const *, Clock::duration>> m_phases;
+	};
+	
+	class Scope {
+	public:
+		Scope(char const * name, PhaseLog * log = nullptr) : m_name { name }, m_log { log } {
+			if (m_log || enabled()) m_start = Clock::now();
+		}
+		Scope(char const * name, std::shared_ptr<PhaseLog> const & log) : Scope { name, log.get() } {}
+		~Scope();
+		
+		Scope(Scope const &) = delete;
+		Scope & operator = (Scope const &) = delete;
+		
+	private:
+		char const * m_name;
+		PhaseLog * m_log;
+		Clock::time_point m_start {};
+	};
+}
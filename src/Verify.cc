@@ -0,0 +1,175 @@
+#include "Verify.hh"
+#include "Format.hh"
+#include "LumpStats.hh"
+#include "Parallel.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+
+#include <algorithm>
+
+namespace {
+	
+	constexpr size_t min_chunk = 16 * 1024;
+	
+	// branch free, so the counting pass over a lump vectorizes
+	// negative values wrap to huge unsigned ones and fail the same comparison
+	inline bool bad_index(int32_t value, size_t count) {
+		return static_cast<uint32_t>(value) >= count;
+	}
+	inline bool bad_optional(int32_t value, size_t count) {
+		return static_cast<uint32_t>(value) + 1u > count; // -1 is allowed, the addition wraps unsigned
+	}
+	inline bool bad_range(int32_t first, int32_t num, size_t count) {
+		int64_t end = static_cast<int64_t>(first) + num;
+		return (first < 0) | (num < 0) | (end > static_cast<int64_t>(count));
+	}
+	
+	// bad(element) -> bool must be cheap and branch free, describe(element) -> std::string is only called on failures
+	// chunks are counted first and only rescanned for messages if they contain a violation
+	template <typename T, typename Bad, typename Describe>
+	Verify::LumpResult check(size_t lump, std::span<T const> elems, size_t max_violations, Bad const & bad, Describe const & describe) {
+		Trace::Scope trace { LumpStats::names[lump] };
+		Verify::LumpResult result = Parallel::reduce_chunks<Verify::LumpResult>(elems.size(), min_chunk, [&](Parallel::Range r){
+			Verify::LumpResult part;
+			size_t count = 0;
+			for (size_t i = r.begin; i < r.end; i++)
+				count += bad(elems[i]);
+			part.violations = count;
+			for (size_t i = r.begin; count && i < r.end && part.first.size() < max_violations; i++)
+				if (bad(elems[i])) part.first.push_back({ i, describe(elems[i]) });
+			return part;
+		}, [&](Verify::LumpResult & into, Verify::LumpResult && part){
+			into.violations += part.violations;
+			for (auto & v : part.first) {
+				if (into.first.size() >= max_violations) break;
+				into.first.push_back(std::move(v));
+			}
+		});
+		result.lump = lump;
+		result.checked = elems.size();
+		return result;
+	}
+}
+
+size_t Verify::Report::violations() const {
+	size_t total = 0;
+	for (auto const & lump : lumps) total += lump.violations;
+	return total;
+}
+
+Verify::Report Verify::run(RawBSP const & raw, size_t max_violations) {
+	Trace::Scope trace { "verify" };
+	using namespace RBSP;
+	
+	auto shaders = raw.lump_as<Shader>(SHADERS).size();
+	auto planes = raw.lump_as<Plane>(PLANES).size();
+	auto nodes = raw.lump_as<Node>(NODES);
+	auto leafs = raw.lump_as<Leaf>(LEAFS);
+	auto leaf_surfaces = raw.lump_as<int32_t>(LEAFSURFACES);
+	auto leaf_brushes = raw.lump_as<int32_t>(LEAFBRUSHES);
+	auto models = raw.lump_as<Model>(MODELS);
+	auto brushes = raw.lump_as<Brush>(BRUSHES);
+	auto brush_sides = raw.lump_as<BrushSide>(BRUSHSIDES);
+	auto draw_verts = raw.lump_as<DrawVert>(DRAWVERTS).size();
+	auto draw_indexes = raw.lump_as<int32_t>(DRAWINDEXES);
+	auto fogs = raw.lump_as<Fog>(FOGS);
+	auto surfaces = raw.lump_as<Surface>(SURFACES);
+	
+	size_t clusters = 0;
+	auto vis = raw.lump(VISIBILITY);
+	if (vis.size() >= sizeof(VisibilityHeader))
+		clusters = std::max(0, reinterpret_cast<VisibilityHeader const *>(vis.data())->num_clusters);
+	
+	Report report;
+	
+	report.lumps.push_back(check(NODES, nodes, max_violations, [&](Node const & n){
+		bool bad = bad_index(n.plane, planes);
+		for (int32_t child : n.children)
+			bad |= (child >= 0) ? bad_index(child, nodes.size()) : bad_index(-(child + 1), leafs.size());
+		return bad;
+	}, [&](Node const & n){
+		return Format::printf("plane %d of %zu, children %d, %d of %zu nodes / %zu leafs", n.plane, planes, n.children[0], n.children[1], nodes.size(), leafs.size());
+	}));
+	
+	report.lumps.push_back(check(LEAFS, leafs, max_violations, [&](Leaf const & l){
+		return bad_range(l.first_leaf_surface, l.num_leaf_surfaces, leaf_surfaces.size())
+			| bad_range(l.first_leaf_brush, l.num_leaf_brushes, leaf_brushes.size())
+			| (clusters && bad_optional(l.cluster, clusters));
+	}, [&](Leaf const & l){
+		return Format::printf("leaf surfaces %d+%d of %zu, leaf brushes %d+%d of %zu, cluster %d of %zu",
+			l.first_leaf_surface, l.num_leaf_surfaces, leaf_surfaces.size(), l.first_leaf_brush, l.num_leaf_brushes, leaf_brushes.size(), l.cluster, clusters);
+	}));
+	
+	report.lumps.push_back(check(LEAFSURFACES, leaf_surfaces, max_violations, [&](int32_t s){
+		return bad_index(s, surfaces.size());
+	}, [&](int32_t s){
+		return Format::printf("surface %d of %zu", s, surfaces.size());
+	}));
+	
+	report.lumps.push_back(check(LEAFBRUSHES, leaf_brushes, max_violations, [&](int32_t b){
+		return bad_index(b, brushes.size());
+	}, [&](int32_t b){
+		return Format::printf("brush %d of %zu", b, brushes.size());
+	}));
+	
+	report.lumps.push_back(check(MODELS, models, max_violations, [&](Model const & m){
+		return bad_range(m.first_surface, m.num_surfaces, surfaces.size()) | bad_range(m.first_brush, m.num_brushes, brushes.size());
+	}, [&](Model const & m){
+		return Format::printf("surfaces %d+%d of %zu, brushes %d+%d of %zu", m.first_surface, m.num_surfaces, surfaces.size(), m.first_brush, m.num_brushes, brushes.size());
+	}));
+	
+	report.lumps.push_back(check(BRUSHES, brushes, max_violations, [&](Brush const & b){
+		return bad_range(b.first_side, b.num_sides, brush_sides.size()) | bad_index(b.shader, shaders);
+	}, [&](Brush const & b){
+		return Format::printf("sides %d+%d of %zu, shader %d of %zu", b.first_side, b.num_sides, brush_sides.size(), b.shader, shaders);
+	}));
+	
+	report.lumps.push_back(check(BRUSHSIDES, brush_sides, max_violations, [&](BrushSide const & s){
+		return bad_index(s.plane, planes) | bad_index(s.shader, shaders) | bad_optional(s.draw_surface, surfaces.size());
+	}, [&](BrushSide const & s){
+		return Format::printf("plane %d of %zu, shader %d of %zu, surface %d of %zu", s.plane, planes, s.shader, shaders, s.draw_surface, surfaces.size());
+	}));
+	
+	report.lumps.push_back(check(FOGS, fogs, max_violations, [&](Fog const & f){
+		return bad_index(f.brush, brushes.size());
+	}, [&](Fog const & f){
+		return Format::printf("brush %d of %zu", f.brush, brushes.size());
+	}));
+	
+	// a surface's indices are relative to its first vertex, so they are checked along with the surface
+	auto bad_indexes = [&](Surface const & s){
+		if (bad_range(s.first_index, s.num_indexes, draw_indexes.size()) || s.num_verts < 0) return true;
+		uint32_t limit = s.num_verts;
+		int32_t const * idx = draw_indexes.data() + s.first_index;
+		bool bad = false;
+		for (int32_t i = 0; i < s.num_indexes; i++)
+			bad |= static_cast<uint32_t>(idx[i]) >= limit;
+		return bad;
+	};
+	report.lumps.push_back(check(SURFACES, surfaces, max_violations, [&](Surface const & s){
+		return bad_index(s.shader, shaders)
+			| bad_optional(s.fog, fogs.size())
+			| bad_range(s.first_vert, s.num_verts, draw_verts)
+			| bad_indexes(s);
+	}, [&](Surface const & s){
+		std::string msg = Format::printf("shader %d of %zu, fog %d of %zu, verts %d+%d of %zu, indexes %d+%d of %zu",
+			s.shader, shaders, s.fog, fogs.size(), s.first_vert, s.num_verts, draw_verts, s.first_index, s.num_indexes, draw_indexes.size());
+		if (!bad_range(s.first_index, s.num_indexes, draw_indexes.size()) && bad_indexes(s)) msg += ", index past num_verts";
+		return msg;
+	}));
+	
+	return report;
+}
+
+std::string Verify::format(Report const & report) {
+	std::string out;
+	for (auto const & lump : report.lumps) {
+		out += Format::printf("%s: %zu checked, %zu violations\n", LumpStats::names[lump.lump], lump.checked, lump.violations);
+		for (auto const & v : lump.first)
+			out += Format::printf("  [%zu] ", v.element) + v.message + '\n';
+		if (lump.violations > lump.first.size())
+			out += Format::printf("  ... %zu more\n", lump.violations - lump.first.size());
+	}
+	return out;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct RawBSP;
+
+// cross-lump index checks over the raw lumps, catching corrupt compiler output without trusting any of it
+namespace Verify {
+	
+	struct Violation {
+		size_t element;
+		std::string message;
+	};
+	
+	struct LumpResult {
+		size_t lump;
+		size_t checked = 0;
+		size_t violations = 0;
+		std::vector<Violation> first; // the first violations found, in element order
+	};
+	
+	struct Report {
+		std::vector<LumpResult> lumps; // lumps with references, in lump order
+		size_t violations() const;
+	};
+	
+	constexpr size_t default_max_violations = 20;
+	
+	// each lump is checked in parallel chunks, safe to call from any thread
+	Report run(RawBSP const & raw, size_t max_violations = default_max_violations);
+	
+	// human readable, one line per lump and per listed violation
+	std::string format(Report const & report);
+}
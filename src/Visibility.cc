@@ -0,0 +1,113 @@
+#include "Visibility.hh"
+#include "Parallel.hh"
+#include "RawBSP.hh"
+#include "RBSP.hh"
+#include "Trace.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+
+// release builds target a baseline without popcnt, an ifunc picks the popcnt clone at load time where available
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define BSPIUM_POPCNT_CLONES __attribute__((target_clones("popcnt", "default")))
+#else
+	#define BSPIUM_POPCNT_CLONES
+#endif
+
+BSPIUM_POPCNT_CLONES uint64_t Visibility::count_bits(uint8_t const * data, size_t len) {
+	uint64_t count = 0;
+	size_t words = len / 8;
+	for (size_t i = 0; i < words; i++) {
+		uint64_t word;
+		std::memcpy(&word, data + i * 8, sizeof(word));
+		count += std::popcount(word);
+	}
+	for (size_t i = words * 8; i < len; i++)
+		count += std::popcount(static_cast<unsigned>(data[i]));
+	return count;
+}
+
+size_t Visibility::Analysis::memory_estimate() const {
+	return sizeof(*this) + (visible.capacity() + worst.capacity()) * sizeof(uint32_t);
+}
+
+std::optional<Visibility::Analysis> Visibility::analyze(RawBSP const & raw, size_t worst_count) {
+	Trace::Scope trace { "visibility analysis" };
+	
+	auto vis = raw.lump(RBSP::VISIBILITY);
+	if (vis.size() < sizeof(RBSP::VisibilityHeader)) return std::nullopt;
+	RBSP::VisibilityHeader head;
+	std::memcpy(&head, vis.data(), sizeof(head));
+	if (head.num_clusters <= 0 || head.cluster_bytes <= 0) return std::nullopt;
+	// the header is untrusted, so sizes are only derived from it once widened
+	size_t clusters = head.num_clusters, row_bytes = head.cluster_bytes;
+	if (row_bytes < (clusters + 7) / 8) return std::nullopt;
+	if ((vis.size() - sizeof(head)) / row_bytes < clusters) return std::nullopt;
+	uint8_t const * rows = vis.data() + sizeof(head);
+	
+	Analysis res;
+	res.clusters = clusters;
+	res.visible.resize(clusters);
+	
+	// rows are padded, bits past the cluster count are not counted
+	size_t full_bytes = clusters / 8;
+	uint8_t tail_mask = (1u << (clusters % 8)) - 1;
+	struct Partial {
+		uint32_t min = UINT32_MAX;
+		uint32_t max = 0;
+		uint64_t sum = 0;
+	};
+	Partial total = Parallel::reduce_chunks<Partial>(clusters, 256, [&](Parallel::Range r){
+		Partial part;
+		for (size_t c = r.begin; c < r.end; c++) {
+			uint8_t const * row = rows + c * row_bytes;
+			uint32_t count = count_bits(row, full_bytes);
+			if (tail_mask) count += std::popcount(static_cast<unsigned>(row[full_bytes] & tail_mask));
+			res.visible[c] = count;
+			part.min = std::min(part.min, count);
+			part.max = std::max(part.max, count);
+			part.sum += count;
+		}
+		return part;
+	}, [](Partial & into, Partial && part){
+		into.min = std::min(into.min, part.min);
+		into.max = std::max(into.max, part.max);
+		into.sum += part.sum;
+	});
+	res.min = total.min;
+	res.max = total.max;
+	res.mean = static_cast<double>(total.sum) / clusters;
+	
+	res.worst.resize(clusters);
+	std::iota(res.worst.begin(), res.worst.end(), 0);
+	size_t worst = std::min(worst_count, clusters);
+	std::partial_sort(res.worst.begin(), res.worst.begin() + worst, res.worst.end(), [&](uint32_t a, uint32_t b){
+		return res.visible[a] != res.visible[b] ? res.visible[a] > res.visible[b] : a < b;
+	});
+	res.worst.resize(worst);
+	res.worst.shrink_to_fit();
+	
+	using Histogram = std::pair<std::array<size_t, Analysis::histogram_buckets>, size_t>; // buckets, opaque
+	auto leafs = raw.lump_as<RBSP::Leaf>(RBSP::LEAFS);
+	Histogram hist = Parallel::reduce_chunks<Histogram>(leafs.size(), 16 * 1024, [&](Parallel::Range r){
+		Histogram part {};
+		for (size_t l = r.begin; l < r.end; l++) {
+			uint32_t cluster = leafs[l].cluster;
+			if (cluster >= clusters) {
+				part.second++;
+				continue;
+			}
+			size_t bucket = uint64_t { res.visible[cluster] } * Analysis::histogram_buckets / clusters;
+			part.first[std::min(bucket, Analysis::histogram_buckets - 1)]++;
+		}
+		return part;
+	}, [](Histogram & into, Histogram && part){
+		for (size_t i = 0; i < into.first.size(); i++) into.first[i] += part.first[i];
+		into.second += part.second;
+	});
+	res.leaf_histogram = hist.first;
+	res.opaque_leafs = hist.second;
+	return res;
+}
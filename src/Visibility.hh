@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+struct RawBSP;
+
+// potentially visible set statistics, to find clusters whose visibility data lets too much through
+namespace Visibility {
+	
+	struct Analysis {
+		static constexpr size_t histogram_buckets = 10;
+		
+		size_t clusters = 0;
+		uint32_t min = 0;
+		uint32_t max = 0;
+		double mean = 0;
+		std::vector<uint32_t> visible; // clusters visible from each cluster
+		std::vector<uint32_t> worst; // clusters seeing the most, most first
+		// leafs by the fraction of all clusters they see, in tenths, the last bucket includes everything
+		std::array<size_t, histogram_buckets> leaf_histogram {};
+		size_t opaque_leafs = 0; // leafs outside of any cluster
+		
+		size_t memory_estimate() const;
+	};
+	
+	constexpr size_t default_worst_count = 20;
+	
+	// parallel over clusters, nullopt if the map has no usable visibility data, safe to call from any thread
+	std::optional<Analysis> analyze(RawBSP const & raw, size_t worst_count = default_worst_count);
+	
+	// set bits in len bytes, hardware popcount where the CPU has one, whatever the build's target
+	uint64_t count_bits(uint8_t const * data, size_t len);
+}